@@ -16,12 +16,21 @@
 // flips by double-sided row hammering.
 //
 // Compilation instructions:
-//   g++ -std=c++11 [filename]
+//   ./make.sh double_sided_rowhammer
 //
-// ./double_sided_rowhammer [-t nsecs] [-p percentage]
+// ./double_sided_rowhammer [-t nsecs] [-p percentage] [-g geometry]
+//                          [-r row bytes] [-a map] [-b radius]
+//                          [-A activations] [-W windows] [-o flips]
 //
 // Hammers for nsecs seconds, acquires the described fraction of memory (0.0
-// to 0.9 or so).
+// to 0.9 or so), backed by the page size of the geometry preset, and treats
+// physical_address / row bytes as the row index. With -a, the aggressor rows
+// of each victim come from an adjacency map learned by pinpoint_rowhammer -l.
+// With -b, the rows up to radius (at most 16) rows outside the aggressors
+// are verified after every run as well, and flips are reported by distance.
+// -A and -W set the hammer budget as in pinpoint_rowhammer. With -o, every
+// flipped target row page is logged with its aggressor pages and flipped
+// bytes, for pinpoint_rowhammer -d.
 //
 // Original author: Thomas Dullien (thomasdullien@google.com)
 
@@ -31,6 +40,7 @@
 #include <fcntl.h>
 #include <inttypes.h>
 #include <linux/kernel-page-flags.h>
+#include <algorithm>
 #include <map>
 #include <stdint.h>
 #include <stdio.h>
@@ -46,6 +56,10 @@
 #include <time.h>
 #include <unistd.h>
 #include <vector>
+#include "pinpoint_adjacency.h"
+#include "pinpoint_calibrate.h"
+#include "pinpoint_discovery.h"
+#include "pinpoint_memory.h"
 
 namespace {
 
@@ -55,154 +69,240 @@ double fraction_of_physical_memory = 0.3;
 // The time to hammer before aborting. Defaults to one hour.
 uint64_t number_of_seconds_to_hammer = 3600;
 
-// The number of memory reads to try.
+// The number of memory reads to try, set from budget once the hammer loop
+// is calibrated on the first page pair.
 uint64_t number_of_reads = 1000*1024;
+bool calibrated = false;
 
-// Obtain the size of the physical memory of the system.
-uint64_t GetPhysicalMemorySize() {
-  struct sysinfo info;
-  sysinfo( &info );
-  return (size_t)info.totalram * (size_t)info.mem_unit;
-}
+// Activations per refresh window (-A, 0 for as fast as possible) and
+// refresh windows (-W) of every page pair.
+HammerBudget budget = {0, 2};
 
-uint64_t GetPageFrameNumber(int pagemap, uint8_t* virtual_address) {
-  // Read the entry in the pagemap.
-  uint64_t value;
-  int got = pread(pagemap, &value, 8,
-                  (reinterpret_cast<uintptr_t>(virtual_address) / 0x1000) * 8);
-  assert(got == 8);
-  uint64_t page_frame_number = value & ((1ULL << 54)-1);
-  return page_frame_number;
-}
+// The presumed row size: physical_address / presumed_row_size is treated as
+// the row index. Defaults to 256 KiB.
+uint64_t presumed_row_size = 1024*256;
+
+// The bank and page geometry of the tested module.
+const DramGeometry* geometry = &kGeometryPresets[0];
+
+// Learned aggressor rows, read with -a. NULL hammers the presumed
+// neighbors.
+AdjacencyMap* adjacency = NULL;
+
+// Rows up to blast_radius rows outside the aggressors are initialized and
+// verified along with the target row. Disturbance fades within a few rows,
+// so larger radii only slow verification down.
+const uint32_t kMaxBlastRadius = 16;
+uint32_t blast_radius = 0;
+
+// A row checked for flips after every hammer run. distance is 0 for the
+// target row between the aggressors, and the distance to the nearer
+// aggressor for rows outside them.
+struct VictimRow {
+  uint64_t row;
+  uint32_t distance;
+  std::vector<MappedPage> pages;
+};
+
+// Flip log of the target rows, opened with -o. NULL logs nothing.
+FILE* flip_log = NULL;
 
-void SetupMapping(uint64_t* mapping_size, void** mapping) {
-  *mapping_size = 
-    static_cast<uint64_t>((static_cast<double>(GetPhysicalMemorySize()) * 
-          fraction_of_physical_memory));
-
-  *mapping = mmap(NULL, *mapping_size, PROT_READ | PROT_WRITE,
-      MAP_POPULATE | MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  assert(*mapping != (void*)-1);
-
-  // Initialize the mapping so that the pages are non-empty.
-  printf("[!] Initializing large memory mapping ...");
-  for (uint64_t index = 0; index < *mapping_size; index += 0x1000) {
-    uint64_t* temporary = reinterpret_cast<uint64_t*>(
-        static_cast<uint8_t*>(*mapping) + index);
-    temporary[0] = index;
+// Victim pages are set to this byte before every run.
+const uint8_t kVictimFill = 0xFF;
+
+// Logs the flipped bytes of a target row page. The log is flushed after
+// every victim, so a run cut off by -t keeps all complete records.
+void LogFlippedPage(const MappedPage& first_page,
+    const MappedPage& victim_page, const MappedPage& second_page,
+    uint8_t bank) {
+  DiscoveredVictim victim;
+  victim.page_frame_numbers[0] = first_page.page_frame_number;
+  victim.page_frame_numbers[1] = victim_page.page_frame_number;
+  victim.page_frame_numbers[2] = second_page.page_frame_number;
+  victim.bank = bank;
+  for (uint32_t index = 0; index < 0x1000; ++index) {
+    uint8_t bits = victim_page.virtual_address[index] ^ kVictimFill;
+    if (bits != 0) {
+      DiscoveredFlip flip = {static_cast<uint16_t>(index), bits};
+      victim.flips.push_back(flip);
+    }
+  }
+  if (!victim.flips.empty() &&
+      (!WriteDiscoveredVictim(flip_log, victim) || fflush(flip_log) != 0)) {
+    fprintf(stderr, "[-] Can't write the flip log\n");
+    exit(EXIT_FAILURE);
   }
-  printf("done\n");
 }
 
-uint64_t HammerAddressesStandard(
-    const std::pair<uint64_t, uint64_t>& first_range,
-    const std::pair<uint64_t, uint64_t>& second_range,
-    uint64_t number_of_reads) {
-  volatile uint64_t* first_pointer =
-      reinterpret_cast<uint64_t*>(first_range.first);
-  volatile uint64_t* second_pointer =
-      reinterpret_cast<uint64_t*>(second_range.first);
-  uint64_t sum = 0;
-
-  while (number_of_reads-- > 0) {
-    sum += first_pointer[0];
-    sum += second_pointer[0];
-    asm volatile(
-        "clflush (%0);\n\t"
-        "clflush (%1);\n\t"
-        : : "r" (first_pointer), "r" (second_pointer) : "memory");
+// Flips found at each distance; index 0 is the target row.
+std::vector<uint64_t> flips_by_distance;
+
+void PrintFlipsByDistance() {
+  for (uint32_t distance = 0; distance < flips_by_distance.size();
+      ++distance) {
+    if (distance == 0) {
+      printf("[!] %lu flips in target rows\n", flips_by_distance[0]);
+    } else {
+      printf("[!] %lu flips in rows at distance %u\n",
+          flips_by_distance[distance], distance);
+    }
   }
-  return sum;
 }
 
-typedef uint64_t(HammerFunction)(
-    const std::pair<uint64_t, uint64_t>& first_range,
-    const std::pair<uint64_t, uint64_t>& second_range,
-    uint64_t number_of_reads);
-
 // A comprehensive test that attempts to hammer adjacent rows for a given 
 // assumed row size (and assumptions of sequential physical addresses for 
-// various rows.
+// various rows, unless an adjacency map says otherwise).
 uint64_t HammerAllReachablePages(uint64_t presumed_row_size, 
     void* memory_mapping, uint64_t memory_mapping_size, HammerFunction* hammer,
     uint64_t number_of_reads) {
   // This vector will be filled with all the pages we can get access to for a
   // given row size.
-  std::vector<std::vector<uint8_t*>> pages_per_row;
+  RowIndex pages_per_row;
   uint64_t total_bitflips = 0;
 
-  pages_per_row.resize(memory_mapping_size / presumed_row_size);
   int pagemap = open("/proc/self/pagemap", O_RDONLY);
   assert(pagemap >= 0);
 
-  printf("[!] Identifying rows for accessible pages ... ");
-  for (uint64_t offset = 0; offset < memory_mapping_size; offset += 0x1000) {
-    uint8_t* virtual_address = static_cast<uint8_t*>(memory_mapping) + offset;
-    uint64_t page_frame_number = GetPageFrameNumber(pagemap, virtual_address);
-    uint64_t physical_address = page_frame_number * 0x1000;
-    uint64_t presumed_row_index = physical_address / presumed_row_size;
-    //printf("[!] put va %lx pa %lx into row %ld\n", (uint64_t)virtual_address,
-    //    physical_address, presumed_row_index);
-    if (presumed_row_index > pages_per_row.size()) {
-      pages_per_row.resize(presumed_row_index);
-    }
-    pages_per_row[presumed_row_index].push_back(virtual_address);
-    //printf("[!] done\n");
-  }
-  printf("Done\n");
+  BuildRowIndex(pagemap, memory_mapping, memory_mapping_size,
+      presumed_row_size, &pages_per_row);
+
+  uint64_t num_pages_per_row = presumed_row_size / 0x1000;
+  std::vector<std::vector<MappedPage>> first_banks;
+  std::vector<std::vector<MappedPage>> target_banks;
+  std::vector<std::vector<MappedPage>> second_banks;
+  std::vector<std::vector<MappedPage>> outer_banks;
+  std::vector<VictimRow> victims;
+  flips_by_distance.assign(blast_radius + 1, 0);
 
   // We should have some pages for most rows now.
-  for (uint64_t row_index = 0; row_index + 2 < pages_per_row.size(); 
-      ++row_index) {
-    if ((pages_per_row[row_index].size() != 64) || 
-        (pages_per_row[row_index+2].size() != 64)) {
-      printf("[!] Can't hammer row %ld - only got %ld/%ld pages "
-          "in the rows above/below\n",
-          row_index+1, pages_per_row[row_index].size(), 
-          pages_per_row[row_index+2].size());
-      continue;
-    } else if (pages_per_row[row_index+1].size() == 0) {
-      printf("[!] Can't hammer row %ld, got no pages from that row\n", 
-          row_index+1);
+  for (uint64_t target_row = 0; target_row < pages_per_row.size();
+      ++target_row) {
+    if (pages_per_row[target_row].size() == 0) {
       continue;
     }
-    printf("[!] Hammering rows %ld/%ld/%ld of %ld (got %ld/%ld/%ld pages)\n", 
-        row_index, row_index+1, row_index+2, pages_per_row.size(), 
-        pages_per_row[row_index].size(), pages_per_row[row_index+1].size(), 
-        pages_per_row[row_index+2].size());
-    // Iterate over all pages we have for the first row.
-    for (uint8_t* first_row_page : pages_per_row[row_index]) {
-      // Iterate over all pages we have for the second row.
-      for (uint8_t* second_row_page : pages_per_row[row_index+2]) {
-        // Set all the target pages to 0xFF.
-        for (uint8_t* target_page : pages_per_row[row_index+1]) {
-          memset(target_page, 0xFF, 0x1000);
+    // Aggressor pages only disturb victims in their own bank, so pair pages
+    // of the same bank and reset and check only that bank's victim pages.
+    GroupPagesByBank(pages_per_row[target_row], *geometry, &target_banks);
+    // The aggressor rows only differ between banks with a map, so they are
+    // checked, reported and grouped once per pair.
+    std::pair<uint64_t, uint64_t> checked_rows(UINT64_MAX, UINT64_MAX);
+    bool complete_rows = false;
+    for (uint8_t bank = 0; bank < geometry->num_banks; ++bank) {
+      uint64_t first_row, second_row;
+      if (target_banks[bank].empty() ||
+          !FindAggressorRows(adjacency, bank, target_row,
+            pages_per_row.size(), &first_row, &second_row)) {
+        continue;
+      }
+      if (checked_rows != std::make_pair(first_row, second_row)) {
+        checked_rows = std::make_pair(first_row, second_row);
+        complete_rows =
+            pages_per_row[first_row].size() == num_pages_per_row &&
+            pages_per_row[second_row].size() == num_pages_per_row;
+        if (!complete_rows) {
+          printf("[!] Can't hammer row %ld - only got %ld/%ld pages in the "
+              "rows %ld/%ld\n", target_row, pages_per_row[first_row].size(),
+              pages_per_row[second_row].size(), first_row, second_row);
+        } else {
+          GroupPagesByBank(pages_per_row[first_row], *geometry,
+              &first_banks);
+          GroupPagesByBank(pages_per_row[second_row], *geometry,
+              &second_banks);
         }
-        // Now hammer the two pages we care about.
-        std::pair<uint64_t, uint64_t> first_page_range(
-            reinterpret_cast<uint64_t>(first_row_page), 
-            reinterpret_cast<uint64_t>(first_row_page+0x1000));
-        std::pair<uint64_t, uint64_t> second_page_range(
-            reinterpret_cast<uint64_t>(second_row_page),
-            reinterpret_cast<uint64_t>(second_row_page+0x1000));
-        hammer(first_page_range, second_page_range, number_of_reads);
-        // Now check the target pages.
-        uint64_t number_of_bitflips_in_target = 0;
-        for (const uint8_t* target_page : pages_per_row[row_index+1]) {
-          for (uint32_t index = 0; index < 0x1000; ++index) {
-            if (target_page[index] != 0xFF) {
-              ++number_of_bitflips_in_target;
-            }
+      }
+      if (!complete_rows) {
+        continue;
+      }
+      printf("[!] Hammering rows %ld/%ld/%ld bank %d of %ld "
+          "(got %ld/%ld/%ld pages)\n", first_row, target_row, second_row,
+          bank, pages_per_row.size(), pages_per_row[first_row].size(),
+          pages_per_row[target_row].size(), pages_per_row[second_row].size());
+
+      // The target row, followed by the rows within the blast radius on
+      // either side of the aggressors.
+      victims.assign(1, VictimRow());
+      victims[0].row = target_row;
+      victims[0].distance = 0;
+      victims[0].pages = target_banks[bank];
+      uint64_t lowest_row = std::min(first_row, second_row);
+      uint64_t highest_row = std::max(first_row, second_row);
+      for (uint32_t distance = 1; distance <= blast_radius; ++distance) {
+        uint64_t outer_rows[2] = {lowest_row - distance,
+            highest_row + distance};
+        for (uint64_t outer_row : outer_rows) {
+          // Rows below zero wrap around and are skipped here too.
+          if (outer_row >= pages_per_row.size() ||
+              outer_row == target_row) {
+            continue;
+          }
+          GroupPagesByBank(pages_per_row[outer_row], *geometry, &outer_banks);
+          if (!outer_banks[bank].empty()) {
+            VictimRow victim = {outer_row, distance, outer_banks[bank]};
+            victims.push_back(victim);
           }
         }
-        if (number_of_bitflips_in_target > 0) {
-          printf("[!] Found %ld flips in row %ld (%lx to %lx) when hammering "
-              "%lx and %lx\n", number_of_bitflips_in_target, row_index+1,
-              ((row_index+1)*presumed_row_size), 
-              ((row_index+2)*presumed_row_size)-1,
-              GetPageFrameNumber(pagemap, first_row_page)*0x1000, 
-              GetPageFrameNumber(pagemap, second_row_page)*0x1000);
-          total_bitflips += number_of_bitflips_in_target;
+      }
+
+      // Iterate over all pages we have for the first row in this bank.
+      for (const MappedPage& first_page : first_banks[bank]) {
+        uint8_t* first_row_page = first_page.virtual_address;
+        // Iterate over all pages we have for the second row in this bank.
+        for (const MappedPage& second_page : second_banks[bank]) {
+          uint8_t* second_row_page = second_page.virtual_address;
+          std::pair<uint64_t, uint64_t> first_page_range(
+              reinterpret_cast<uint64_t>(first_row_page),
+              reinterpret_cast<uint64_t>(first_row_page+0x1000));
+          std::pair<uint64_t, uint64_t> second_page_range(
+              reinterpret_cast<uint64_t>(second_row_page),
+              reinterpret_cast<uint64_t>(second_row_page+0x1000));
+          // Calibrate before the victims are set, so the calibration reads
+          // do not count towards the flips of this pair.
+          if (!calibrated) {
+            number_of_reads = CalibrateBudget("double-sided hammer",
+                [&](uint64_t reads) {
+                  hammer(first_page_range, second_page_range, reads);
+                }, budget);
+            calibrated = true;
+          }
+          // Set all the victim pages of the bank to kVictimFill.
+          for (const VictimRow& victim : victims) {
+            for (const MappedPage& victim_page : victim.pages) {
+              memset(victim_page.virtual_address, kVictimFill, 0x1000);
+            }
+          }
+          // Now hammer the two pages we care about.
+          hammer(first_page_range, second_page_range, number_of_reads);
+          // Now check the victim pages of the bank.
+          for (const VictimRow& victim : victims) {
+            uint64_t number_of_bitflips_in_victim = 0;
+            for (const MappedPage& victim_page : victim.pages) {
+              for (uint32_t index = 0; index < 0x1000; ++index) {
+                if (victim_page.virtual_address[index] != kVictimFill) {
+                  ++number_of_bitflips_in_victim;
+                }
+              }
+            }
+            if (number_of_bitflips_in_victim == 0) {
+              continue;
+            }
+            if (flip_log != NULL && victim.distance == 0) {
+              for (const MappedPage& victim_page : victim.pages) {
+                LogFlippedPage(first_page, victim_page, second_page, bank);
+              }
+            }
+            printf("[!] Found %ld flips in row %ld bank %d (%lx to %lx) when "
+                "hammering %lx and %lx", number_of_bitflips_in_victim,
+                victim.row, bank, (victim.row*presumed_row_size),
+                ((victim.row+1)*presumed_row_size)-1,
+                first_page.page_frame_number*0x1000,
+                second_page.page_frame_number*0x1000);
+            if (victim.distance > 0) {
+              printf(", %u rows outside the aggressors", victim.distance);
+            }
+            printf("\n");
+            flips_by_distance[victim.distance] += number_of_bitflips_in_victim;
+            total_bitflips += number_of_bitflips_in_victim;
+          }
         }
       }
     }
@@ -213,15 +313,18 @@ uint64_t HammerAllReachablePages(uint64_t presumed_row_size,
 void HammerAllReachableRows(HammerFunction* hammer, uint64_t number_of_reads) {
   uint64_t mapping_size;
   void* mapping;
-  SetupMapping(&mapping_size, &mapping);
+  SetupMapping(fraction_of_physical_memory, geometry->page_bytes,
+      &mapping_size, &mapping);
 
-  HammerAllReachablePages(1024*256, mapping, mapping_size,
+  HammerAllReachablePages(presumed_row_size, mapping, mapping_size,
                           hammer, number_of_reads);
+  PrintFlipsByDistance();
 }
 
 void HammeredEnough(int sig) {
   printf("[!] Spent %ld seconds hammering, exiting now.\n",
       number_of_seconds_to_hammer);
+  PrintFlipsByDistance();
   fflush(stdout);
   fflush(stderr);
   exit(0);
@@ -234,7 +337,7 @@ int main(int argc, char** argv) {
   setvbuf(stdout, NULL, _IONBF, 0);
 
   int opt;
-  while ((opt = getopt(argc, argv, "t:p:")) != -1) {
+  while ((opt = getopt(argc, argv, "t:p:g:r:a:b:A:W:o:")) != -1) {
     switch (opt) {
       case 't':
         number_of_seconds_to_hammer = atoi(optarg);
@@ -242,13 +345,72 @@ int main(int argc, char** argv) {
       case 'p':
         fraction_of_physical_memory = atof(optarg);
         break;
+      case 'g':
+        geometry = FindGeometry(optarg);
+        if (geometry == NULL) {
+          fprintf(stderr, "[-] Unknown geometry %s, choose one of:\n", optarg);
+          PrintGeometryPresets(stderr);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'r':
+        presumed_row_size = strtoull(optarg, NULL, 0);
+        if (presumed_row_size == 0 || presumed_row_size % 0x1000 != 0) {
+          fprintf(stderr, "[-] Row size must be a multiple of 4096\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'a':
+        adjacency = new AdjacencyMap();
+        if (!ReadAdjacencyMap(optarg, adjacency)) {
+          fprintf(stderr, "[-] Can't read adjacency map %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'b': {
+        int64_t radius = strtoll(optarg, NULL, 0);
+        if (radius < 0 || radius > kMaxBlastRadius) {
+          fprintf(stderr, "[-] The blast radius must be between 0 and %u\n",
+              kMaxBlastRadius);
+          exit(EXIT_FAILURE);
+        }
+        blast_radius = radius;
+        break;
+      }
+      case 'A':
+        budget.activations_per_window = strtoull(optarg, NULL, 0);
+        break;
+      case 'W':
+        budget.windows = atoi(optarg);
+        if (budget.windows == 0) {
+          fprintf(stderr, "[-] At least one refresh window is needed\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'o':
+        flip_log = fopen(optarg, "wb");
+        if (flip_log == NULL || !WriteDiscoveryHeader(flip_log, kVictimFill)) {
+          fprintf(stderr, "[-] Can't write flip log %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        break;
       default:
-        fprintf(stderr, "Usage: %s [-t nsecs] [-p percent]\n", 
-            argv[0]);
+        fprintf(stderr, "Usage: %s [-t nsecs] [-p percent] [-g geometry] "
+            "[-r row bytes] [-a map] [-b radius] [-A activations] "
+            "[-W windows] [-o flips]\n", argv[0]);
         exit(EXIT_FAILURE);
     }
   }
 
+  if (adjacency != NULL && (adjacency->presumed_row_size != presumed_row_size
+        || adjacency->num_banks != geometry->num_banks)) {
+    fprintf(stderr, "[-] The adjacency map was learned for %lu-byte rows and "
+        "%u banks, pass -r %lu and a matching -g\n",
+        adjacency->presumed_row_size, adjacency->num_banks,
+        adjacency->presumed_row_size);
+    exit(EXIT_FAILURE);
+  }
+
   signal(SIGALRM, HammeredEnough);
 
   printf("[!] Starting the testing process...\n");
@@ -16,9 +16,49 @@
 
 set -eu
 
-cflags="-g -Werror -O2"
+cflags="-g -Werror -O2 -std=c++11 -pthread"
+
+# Shared mapping, indexing, pattern generation and verification code.
+library_sources="pinpoint_geometry.cc pinpoint_memory.cc pinpoint_module.cc
+  pinpoint_characterize.cc pinpoint_pipeline.cc pinpoint_adjacency.cc
+  pinpoint_shard.cc pinpoint_telemetry.cc pinpoint_calibrate.cc
+  pinpoint_discovery.cc"
+
+build_library() {
+  objects=""
+  for source in $library_sources; do
+    g++ $cflags -c $source -o ${source%.cc}.o
+    objects="$objects ${source%.cc}.o"
+  done
+  ar rcs libpinpoint.a $objects
+}
+
+build_binary() {
+  g++ $cflags $1.cc libpinpoint.a -o $1
+}
+
+# Usage: ./make.sh [libpinpoint|pinpoint_rowhammer|double_sided_rowhammer|
+#                   pinpoint_benchmark|pinpoint_top|all]
+target=${1:-all}
 
 if [ "$(uname)" = Linux ]; then
-  g++ $cflags -std=c++11 pinpoint_rowhammer.cc pinpoint_module.cc -o pinpoint_rowhammer
-  g++ $cflags -std=c++11 double_sided_rowhammer.cc -o double_sided_rowhammer
+  build_library
+  case $target in
+    libpinpoint)
+      ;;
+    pinpoint_rowhammer|double_sided_rowhammer|pinpoint_benchmark|\
+    pinpoint_top)
+      build_binary $target
+      ;;
+    all)
+      build_binary pinpoint_rowhammer
+      build_binary double_sided_rowhammer
+      build_binary pinpoint_benchmark
+      build_binary pinpoint_top
+      ;;
+    *)
+      echo "Unknown target: $target" >&2
+      exit 1
+      ;;
+  esac
 fi
@@ -0,0 +1,243 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_adjacency.h"
+
+#include <stdio.h>
+#include <string.h>
+#include "pinpoint_serialize.h"
+
+namespace {
+
+const char kMapMagic[8] = {'P', 'P', 'A', 'D', 'J', '1', '\0', '\0'};
+
+}  // namespace
+
+void InitAdjacencyMap(const DramGeometry& geometry, AdjacencyMap* map) {
+  map->presumed_row_size = PresumedRowSize(geometry);
+  map->num_banks = geometry.num_banks;
+  map->banks.clear();
+  map->banks.resize(geometry.num_banks);
+}
+
+uint32_t LearnRowNeighbors(
+    const PinpointKernels& kernels,
+    const RowIndex& pages_per_row,
+    const DramGeometry& geometry,
+    uint64_t target_row,
+    uint8_t bank,
+    const DataPattern& pattern,
+    uint64_t number_of_reads,
+    AdjacencyMap* map) {
+  const MappedPage* target_page =
+      FindRowInBank(pages_per_row[target_row], bank, geometry);
+  if (target_page == NULL) {
+    return 0;
+  }
+
+  // Candidate aggressors: the bank part of every row within the window.
+  int offsets[2 * kAdjacencyWindow];
+  const MappedPage* pages[2 * kAdjacencyWindow];
+  uint32_t num_candidates = 0;
+  for (int offset = -kAdjacencyWindow; offset <= kAdjacencyWindow; offset++) {
+    if (offset == 0 || (offset < 0 && target_row < static_cast<uint64_t>(
+          -offset)) || target_row + offset >= pages_per_row.size()) {
+      continue;
+    }
+    const MappedPage* page =
+        FindRowInBank(pages_per_row[target_row + offset], bank, geometry);
+    if (page != NULL) {
+      offsets[num_candidates] = offset;
+      pages[num_candidates] = page;
+      num_candidates++;
+    }
+  }
+  // Without a pair nothing was tested; a later mapping may have one.
+  if (num_candidates < 2) {
+    return 0;
+  }
+
+  uint64_t results[kMaxRowWords];
+  RowNeighbors best = {0, 0};
+  uint32_t best_count = 0;
+  RowTriple rows;
+  rows.target_row = reinterpret_cast<uint64_t*>(target_page->virtual_address);
+  for (uint32_t i = 0; i < num_candidates; i++) {
+    for (uint32_t j = i + 1; j < num_candidates; j++) {
+      rows.first_row = reinterpret_cast<uint64_t*>(pages[i]->virtual_address);
+      rows.second_row =
+          reinterpret_cast<uint64_t*>(pages[j]->virtual_address);
+      kernels.hammer_with_pattern(rows, pattern, number_of_reads, results);
+      uint32_t count = kernels.count_bit_flips(results);
+      if (count > best_count) {
+        best_count = count;
+        best.first = offsets[i];
+        best.second = offsets[j];
+      }
+    }
+  }
+
+  map->banks[bank][target_row] = best;
+  return best_count;
+}
+
+bool FindAggressorRows(
+    const AdjacencyMap* map,
+    uint8_t bank,
+    uint64_t target_row,
+    uint64_t num_rows,
+    uint64_t* first_row,
+    uint64_t* second_row) {
+  RowNeighbors neighbors = {-1, 1};
+  if (map != NULL) {
+    std::map<uint64_t, RowNeighbors>::const_iterator learned =
+        map->banks[bank].find(target_row);
+    if (learned != map->banks[bank].end()) {
+      neighbors = learned->second;
+    }
+  }
+  if (IsQuietRow(neighbors)) {
+    return false;
+  }
+
+  int64_t first = static_cast<int64_t>(target_row) + neighbors.first;
+  int64_t second = static_cast<int64_t>(target_row) + neighbors.second;
+  if (first < 0 || second < 0 || static_cast<uint64_t>(first) >= num_rows ||
+      static_cast<uint64_t>(second) >= num_rows) {
+    return false;
+  }
+  *first_row = first;
+  *second_row = second;
+  return true;
+}
+
+bool BuildRowTriple(
+    const RowIndex& pages_per_row,
+    const DramGeometry& geometry,
+    const AdjacencyMap* map,
+    uint64_t target_row,
+    uint8_t bank,
+    RowTriple* rows,
+    uint64_t page_frame_numbers[3]) {
+  uint64_t first_row, second_row;
+  if (!FindAggressorRows(map, bank, target_row, pages_per_row.size(),
+        &first_row, &second_row)) {
+    return false;
+  }
+  const MappedPage* first_page =
+      FindRowInBank(pages_per_row[first_row], bank, geometry);
+  const MappedPage* second_page =
+      FindRowInBank(pages_per_row[second_row], bank, geometry);
+  const MappedPage* target_page =
+      FindRowInBank(pages_per_row[target_row], bank, geometry);
+  if (first_page == NULL || second_page == NULL || target_page == NULL) {
+    return false;
+  }
+  rows->first_row = reinterpret_cast<uint64_t*>(first_page->virtual_address);
+  rows->second_row =
+      reinterpret_cast<uint64_t*>(second_page->virtual_address);
+  rows->target_row =
+      reinterpret_cast<uint64_t*>(target_page->virtual_address);
+  page_frame_numbers[0] = first_page->page_frame_number;
+  page_frame_numbers[1] = target_page->page_frame_number;
+  page_frame_numbers[2] = second_page->page_frame_number;
+  return true;
+}
+
+bool WriteAdjacencyMap(const char* path, const AdjacencyMap& map) {
+  FILE* file = fopen(path, "wb");
+  if (file == NULL) {
+    return false;
+  }
+  bool ok = fwrite(kMapMagic, sizeof(kMapMagic), 1, file) == 1;
+  ok = ok && WriteValue(file, map.presumed_row_size);
+  ok = ok && WriteValue(file, map.num_banks);
+  for (uint32_t bank = 0; ok && bank < map.num_banks; bank++) {
+    std::vector<uint8_t> encoded;
+    uint64_t previous_row = 0;
+    for (const auto& entry : map.banks[bank]) {
+      AppendVarint(entry.first - previous_row, &encoded);
+      encoded.push_back(static_cast<uint8_t>(entry.second.first));
+      encoded.push_back(static_cast<uint8_t>(entry.second.second));
+      previous_row = entry.first;
+    }
+    ok = WriteValue(file, static_cast<uint32_t>(map.banks[bank].size())) &&
+        WriteValue(file, static_cast<uint32_t>(encoded.size())) &&
+        fwrite(encoded.data(), 1, encoded.size(), file) == encoded.size();
+  }
+  return fclose(file) == 0 && ok;
+}
+
+bool ReadAdjacencyMap(const char* path, AdjacencyMap* map) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char magic[sizeof(kMapMagic)];
+  bool ok = fread(magic, sizeof(magic), 1, file) == 1 &&
+      memcmp(magic, kMapMagic, sizeof(magic)) == 0 &&
+      ReadValue(file, &map->presumed_row_size) &&
+      ReadValue(file, &map->num_banks) &&
+      map->num_banks > 0 && map->num_banks <= 256;
+
+  map->banks.clear();
+  if (ok) {
+    map->banks.resize(map->num_banks);
+  }
+  for (uint32_t bank = 0; ok && bank < map->num_banks; bank++) {
+    uint32_t num_rows, encoded_size;
+    ok = ReadValue(file, &num_rows) && ReadValue(file, &encoded_size);
+    std::vector<uint8_t> encoded(ok ? encoded_size : 0);
+    ok = ok && fread(encoded.data(), 1, encoded_size, file) == encoded_size;
+
+    size_t offset = 0;
+    uint64_t row = 0;
+    for (uint32_t n = 0; ok && n < num_rows; n++) {
+      uint32_t delta;
+      ok = ReadVarint(encoded, &offset, &delta) &&
+          offset + 2 <= encoded.size();
+      if (ok) {
+        row += delta;
+        RowNeighbors neighbors;
+        neighbors.first = static_cast<int8_t>(encoded[offset++]);
+        neighbors.second = static_cast<int8_t>(encoded[offset++]);
+        map->banks[bank][row] = neighbors;
+      }
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+void PrintAdjacencySummary(const AdjacencyMap& map) {
+  uint64_t total_learned = 0;
+  printf("[!] Adjacency map for %lu-byte rows, %u banks\n",
+      map.presumed_row_size, map.num_banks);
+  for (uint32_t bank = 0; bank < map.num_banks; bank++) {
+    uint64_t quiet = 0;
+    uint64_t remapped = 0;
+    for (const auto& entry : map.banks[bank]) {
+      const RowNeighbors& neighbors = entry.second;
+      if (IsQuietRow(neighbors)) {
+        quiet++;
+      } else if (neighbors.first != -1 || neighbors.second != 1) {
+        remapped++;
+      }
+    }
+    total_learned += map.banks[bank].size();
+    printf("[!] bank %2u: %8zu rows learned, %8lu remapped, %8lu quiet\n",
+        bank, map.banks[bank].size(), remapped, quiet);
+  }
+  printf("[!] %lu rows learned in total\n", total_learned);
+}
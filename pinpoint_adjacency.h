@@ -0,0 +1,113 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Empirically learned row adjacency.
+//
+// The drivers treat physical_address / presumed_row_size as the row index
+// and hammer rows i-1 and i+1 around victim i. Internal row remapping and
+// mirroring break that assumption. LearnRowNeighbors() hammers every pair of
+// rows within kAdjacencyWindow of a victim in one bank and records the pair
+// that flips the victim most; BuildRowTriple() then uses those rows instead
+// of the presumed neighbors. Victims that no pair flips are marked quiet and
+// skipped.
+//
+// Map file layout (little endian):
+//   "PPADJ1\0\0"
+//   uint64 presumed_row_size, uint32 num_banks
+//   num_banks x {uint32 num_rows, uint32 encoded length, encoded rows}
+// Encoded rows, in row order: a varint of the row index delta to the
+// previous row of the bank, followed by the int8 offsets of the first and
+// second aggressor (both 0 for a quiet row).
+
+#ifndef PINPOINT_ADJACENCY_H_
+#define PINPOINT_ADJACENCY_H_
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+#include "pinpoint_geometry.h"
+#include "pinpoint_memory.h"
+#include "pinpoint_module.h"
+
+// Aggressor candidates are at most this many rows away from the victim.
+const int kAdjacencyWindow = 2;
+
+// Aggressor rows of a victim, relative to the victim row index.
+struct RowNeighbors {
+  int8_t first;
+  int8_t second;
+};
+
+// Quiet rows did not flip with any aggressor pair.
+inline bool IsQuietRow(const RowNeighbors& neighbors) {
+  return neighbors.first == 0 && neighbors.second == 0;
+}
+
+struct AdjacencyMap {
+  uint64_t presumed_row_size;
+  uint32_t num_banks;
+  // Learned victims of each bank, keyed by row index. Rows that were not
+  // learned keep the presumed neighbors.
+  std::vector<std::map<uint64_t, RowNeighbors>> banks;
+};
+
+void InitAdjacencyMap(const DramGeometry& geometry, AdjacencyMap* map);
+
+// Hammers every pair of rows within kAdjacencyWindow of target_row in bank
+// with pattern and stores the pair that flips the most bits of target_row.
+// Returns the number of flips of that pair; 0 marks the row quiet. Returns 0
+// without touching map if target_row has no page in bank, or fewer than two
+// rows of the window do.
+uint32_t LearnRowNeighbors(
+    const PinpointKernels& kernels,
+    const RowIndex& pages_per_row,
+    const DramGeometry& geometry,
+    uint64_t target_row,
+    uint8_t bank,
+    const DataPattern& pattern,
+    uint64_t number_of_reads,
+    AdjacencyMap* map);
+
+// Picks the aggressor rows of target_row in bank: the learned ones if map
+// has them, otherwise target_row-1 and target_row+1. map may be NULL.
+// Returns false if the row is quiet or an aggressor is out of range.
+bool FindAggressorRows(
+    const AdjacencyMap* map,
+    uint8_t bank,
+    uint64_t target_row,
+    uint64_t num_rows,
+    uint64_t* first_row,
+    uint64_t* second_row);
+
+// Fills rows and page_frame_numbers (first, target, second) with the bank
+// part of target_row and of its aggressors from FindAggressorRows(). Returns
+// false if there are no aggressors or a row has no contiguous part in bank.
+bool BuildRowTriple(
+    const RowIndex& pages_per_row,
+    const DramGeometry& geometry,
+    const AdjacencyMap* map,
+    uint64_t target_row,
+    uint8_t bank,
+    RowTriple* rows,
+    uint64_t page_frame_numbers[3]);
+
+// Returns false on I/O errors or a malformed map.
+bool WriteAdjacencyMap(const char* path, const AdjacencyMap& map);
+bool ReadAdjacencyMap(const char* path, AdjacencyMap* map);
+
+// Prints how many rows were learned per bank and how many of them deviate
+// from the presumed neighbors.
+void PrintAdjacencySummary(const AdjacencyMap& map);
+
+#endif  // PINPOINT_ADJACENCY_H_
@@ -0,0 +1,1028 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark for the CPU-side analysis kernels of Pinpoint Rowhammer.
+//
+// Runs ComputePinpointData, the alternating pattern computation and flip
+// verification on synthetic flip results, so neither root nor vulnerable
+// DRAM is needed. Every kernel is timed against a copy of the original
+// implementation and their outputs are compared.
+//
+// Compilation instructions:
+//   ./make.sh pinpoint_benchmark
+//
+// ./pinpoint_benchmark [-i iterations] [-f flips per row] [-s seed]
+
+#include <algorithm>
+#include <atomic>
+#include <fcntl.h>
+#include <new>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <thread>
+#include <time.h>
+#include <unistd.h>
+#include <vector>
+#include "pinpoint_adjacency.h"
+#include "pinpoint_calibrate.h"
+#include "pinpoint_characterize.h"
+#include "pinpoint_discovery.h"
+#include "pinpoint_module.h"
+#include "pinpoint_pipeline.h"
+#include "pinpoint_shard.h"
+
+namespace {
+
+// The number of times each kernel is run.
+uint32_t number_of_iterations = 20;
+
+// The number of flipped bits per pattern in the synthetic results.
+uint32_t flips_per_row = 64;
+
+// Seed of the synthetic results.
+uint64_t seed = 0x5eed;
+
+// The original implementation works on 8 KiB rows only.
+const uint32_t kOriginalRowWords = 1024;
+
+// Kernels compared against the original implementation.
+const PinpointKernels* kernels;
+
+// The implementation before the kernels were moved into the library, kept as
+// the baseline for comparison.
+namespace original {
+
+#define ZERO 0x0000000000000000UL
+#define ONE 0xffffffffffffffffUL
+
+uint64_t first_data[8] ={ZERO, ZERO, ONE, ONE, ZERO, ZERO, ONE, ONE};
+uint64_t target_data[8]={ZERO, ZERO, ZERO, ZERO, ONE, ONE, ONE, ONE};
+uint64_t second_data[8]={ZERO, ONE, ONE, ZERO, ZERO, ONE, ONE, ZERO};
+
+#undef ZERO
+#undef ONE
+
+void AlternateOnePattern(
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024],
+    uint8_t pattern,
+    uint32_t index,
+    uint64_t bit_mask) {
+  for (uint8_t i=0; i<12; i++) {
+    first_alter[i][index] = (first_alter[i][index]&(~bit_mask))|
+        (first_data[pattern]&bit_mask);
+    second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
+        (second_data[pattern]&bit_mask);
+  }
+}
+
+void AlternateTwoPatterns(
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024],
+    uint8_t first_pattern,
+    uint8_t second_pattern,
+    uint32_t index,
+    uint64_t bit_mask) {
+  for (uint8_t i=0; i<12; i+=2) {
+    first_alter[i][index] = (first_alter[i][index]&(~bit_mask))|
+        (first_data[first_pattern]&bit_mask);
+    second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
+        (second_data[first_pattern]&bit_mask);
+
+    first_alter[i+1][index] = (first_alter[i+1][index]&(~bit_mask))|
+        (first_data[second_pattern]&bit_mask);
+    second_alter[i+1][index] = (second_alter[i+1][index]&(~bit_mask))|
+        (second_data[second_pattern]&bit_mask);
+  }
+}
+
+void AlternateThreePatterns(
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024],
+    uint8_t first_pattern,
+    uint8_t second_pattern,
+    uint8_t third_pattern,
+    uint32_t index,
+    uint64_t bit_mask) {
+  for (uint8_t i=0; i<12; i+=3) {
+    first_alter[i][index] = (first_alter[i][index]&(~bit_mask))|
+        (first_data[first_pattern]&bit_mask);
+    second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
+        (second_data[first_pattern]&bit_mask);
+
+    first_alter[i+1][index] = (first_alter[i+1][index]&(~bit_mask))|
+        (first_data[second_pattern]&bit_mask);
+    second_alter[i+1][index] = (second_alter[i+1][index]&(~bit_mask))|
+        (second_data[second_pattern]&bit_mask);
+
+    first_alter[i+2][index] = (first_alter[i+2][index]&(~bit_mask))|
+        (first_data[third_pattern]&bit_mask);
+    second_alter[i+2][index] = (second_alter[i+2][index]&(~bit_mask))|
+        (second_data[third_pattern]&bit_mask);
+  }
+}
+
+void AlternateFourPatterns(
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024],
+    uint32_t index,
+    uint64_t bit_mask) {
+  for (uint8_t i=0; i<12; i++) {
+    first_alter[i][index] = ((first_alter[i][index]&(~bit_mask))|
+        (first_data[i%4]&bit_mask));
+    second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
+        (second_data[i%4]&bit_mask);
+  }
+}
+
+void ComputePinpointData(
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024],
+    uint32_t index,
+    uint64_t bit_mask,
+    uint8_t flip_results) {
+  switch (flip_results) {
+    case 0b0000:
+    case 0b1111:
+      AlternateFourPatterns(first_alter, second_alter, index, bit_mask);
+      break;
+    case 0b0001:
+      AlternateThreePatterns(first_alter, second_alter, 0, 1, 2, index, bit_mask);
+      break;
+    case 0b0010:
+      AlternateThreePatterns(first_alter, second_alter, 0, 1, 3, index, bit_mask);
+      break;
+    case 0b0100:
+      AlternateThreePatterns(first_alter, second_alter, 0, 2, 3, index, bit_mask);
+      break;
+    case 0b1000:
+      AlternateThreePatterns(first_alter, second_alter, 1, 2, 3, index, bit_mask);
+      break;
+    case 0b0011:
+      AlternateTwoPatterns(first_alter, second_alter, 0, 1, index, bit_mask);
+      break;
+    case 0b0101:
+      AlternateTwoPatterns(first_alter, second_alter, 0, 2, index, bit_mask);
+      break;
+    case 0b0110:
+      AlternateTwoPatterns(first_alter, second_alter, 0, 3, index, bit_mask);
+      break;
+    case 0b1001:
+      AlternateTwoPatterns(first_alter, second_alter, 1, 2, index, bit_mask);
+      break;
+    case 0b1010:
+      AlternateTwoPatterns(first_alter, second_alter, 1, 3, index, bit_mask);
+      break;
+    case 0b1100:
+      AlternateTwoPatterns(first_alter, second_alter, 2, 3, index, bit_mask);
+      break;
+    case 0b0111:
+      AlternateOnePattern(first_alter, second_alter, 0, index, bit_mask);
+      break;
+    case 0b1011:
+      AlternateOnePattern(first_alter, second_alter, 1, index, bit_mask);
+      break;
+    case 0b1101:
+      AlternateOnePattern(first_alter, second_alter, 2, index, bit_mask);
+      break;
+    case 0b1110:
+      AlternateOnePattern(first_alter, second_alter, 3, index, bit_mask);
+      break;
+  }
+}
+
+// The victim agnostic and alternating pattern loop of pinpoint_rowhammer.cc.
+uint32_t ComputeAlternatingPattern(
+    uint64_t results[][1024],
+    uint32_t target_index,
+    uint32_t target_bit_offset,
+    uint32_t default_pattern,
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024]) {
+  uint32_t target_pattern = default_pattern;
+  uint64_t target_bit_mask = 1UL<<target_bit_offset;
+
+  for (uint8_t pattern=0; pattern<4; pattern++) {
+    for (uint32_t index=0; index<1024; index++) {
+      results[pattern][index] |= results[pattern+4][index];
+    }
+  }
+
+  for (uint32_t index=0; index<1024; index++) {
+    for (uint32_t bit_offset=0; bit_offset<64; bit_offset++) {
+      uint64_t bit_mask = 1UL << bit_offset;
+      uint8_t sum=0;
+      for (uint8_t pattern=0; pattern<4; pattern++) {
+        sum += ((results[pattern][index]&bit_mask)>>bit_offset)<<(3-pattern);
+        if ((index==target_index) && (bit_offset==target_bit_offset))
+          switch (sum) {
+            case 0b0010:
+            case 0b0011:
+            case 0b0110:
+            case 0b0111:
+            case 0b1010:
+            case 0b1011:
+            case 0b1110:
+            case 0b1111:
+              target_pattern=2;
+              break;
+            case 0b1000:
+            case 0b1001:
+            case 0b1100:
+            case 0b1101:
+              target_pattern=0;
+              break;
+            case 0b0001:
+            case 0b0101:
+              target_pattern=3;
+              break;
+            case 0b0100:
+              target_pattern=1;
+              break;
+            case 0b0000:
+              target_pattern=default_pattern;
+              break;
+          }
+      }
+      ComputePinpointData(first_alter, second_alter, index, bit_mask, sum);
+    }
+  }
+
+  for (uint8_t i=0; i<12; i++) {
+    first_alter[i][target_index] =
+        (first_alter[i][target_index]&(~target_bit_mask))|
+        (first_data[target_pattern]&target_bit_mask);
+    second_alter[i][target_index] =
+        (second_alter[i][target_index]&(~target_bit_mask))|
+        (second_data[target_pattern]&target_bit_mask);
+  }
+  return target_pattern;
+}
+
+// The flip counting loop of pinpoint_rowhammer.cc.
+uint32_t CountBitFlips(
+    const uint64_t* results,
+    uint32_t* target_index,
+    uint32_t* target_bit_offset) {
+  uint32_t count = 0;
+  *target_index = -1;
+  for (uint32_t index=0; index<1024; index++) {
+    if (results[index] != 0) {
+      uint64_t temp = results[index];
+      for (uint32_t bit_offset=0; bit_offset<64; bit_offset++) {
+        count += (temp>>bit_offset)&1;
+        if (((temp>>bit_offset)&1) && *target_index == (uint32_t)-1) {
+          *target_index = index;
+          *target_bit_offset = bit_offset;
+        }
+      }
+    }
+  }
+  return count;
+}
+
+}  // namespace original
+
+uint64_t NextRandom(uint64_t* state) {
+  // xorshift64*
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+// Fills scan with flips_per_row random bit flips per pattern. Half of the
+// flips of a pattern are shared with the next pattern so that the victim
+// agnostic sums hit more than the all-zero case.
+void GenerateScan(uint64_t* state, uint32_t row_words, PatternScan* scan) {
+  memset(scan, 0, sizeof(*scan));
+  for (uint32_t pattern = 0; pattern < kNumDataPatterns; pattern++) {
+    for (uint32_t flip = 0; flip < flips_per_row; flip++) {
+      uint64_t random = NextRandom(state);
+      uint32_t index = (random >> 8) % row_words;
+      uint64_t bit_mask = 1UL << (random & 63);
+      scan->results[pattern][index] |= bit_mask;
+      if (flip % 2 == 0) {
+        scan->results[(pattern+1) % kNumDataPatterns][index] |= bit_mask;
+      }
+    }
+  }
+}
+
+double Now() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+void Report(const char* name, double library, double reference) {
+  printf("[!] %-26s library %10.1f us/op  original %10.1f us/op  (%.2fx)\n",
+      name, library * 1e6 / number_of_iterations,
+      reference * 1e6 / number_of_iterations, reference / library);
+}
+
+bool SameAlternatingData(
+    const AlternatingData& alter,
+    uint64_t first_alter[][1024],
+    uint64_t second_alter[][1024]) {
+  for (uint32_t i = 0; i < kAlternatingPhases; i++) {
+    if (memcmp(alter.first_alter[i], first_alter[i], 8*kOriginalRowWords) ||
+        memcmp(alter.second_alter[i], second_alter[i], 8*kOriginalRowWords)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Returns false if the library and the original implementation disagree.
+bool BenchmarkComputePinpointData() {
+  static AlternatingData alter;
+  static uint64_t first_alter[12][1024];
+  static uint64_t second_alter[12][1024];
+  memset(&alter, 0, sizeof(alter));
+  memset(first_alter, 0, sizeof(first_alter));
+  memset(second_alter, 0, sizeof(second_alter));
+
+  double start = Now();
+  for (uint32_t iteration = 0; iteration < number_of_iterations; iteration++) {
+    for (uint32_t index = 0; index < kOriginalRowWords; index++) {
+      for (uint32_t bit_offset = 0; bit_offset < 64; bit_offset++) {
+        ComputePinpointData(&alter, index, 1UL << bit_offset,
+            (index + bit_offset + iteration) & 0xf);
+      }
+    }
+  }
+  double library = Now() - start;
+
+  start = Now();
+  for (uint32_t iteration = 0; iteration < number_of_iterations; iteration++) {
+    for (uint32_t index = 0; index < 1024; index++) {
+      for (uint32_t bit_offset = 0; bit_offset < 64; bit_offset++) {
+        original::ComputePinpointData(first_alter, second_alter, index,
+            1UL << bit_offset, (index + bit_offset + iteration) & 0xf);
+      }
+    }
+  }
+  double reference = Now() - start;
+
+  Report("ComputePinpointData", library, reference);
+  return SameAlternatingData(alter, first_alter, second_alter);
+}
+
+bool BenchmarkAlternatingPattern() {
+  static PatternScan input;
+  static PatternScan scan;
+  static AlternatingData alter;
+  static uint64_t results[8][1024];
+  static uint64_t first_alter[12][1024];
+  static uint64_t second_alter[12][1024];
+  uint64_t state = seed;
+  uint8_t default_pattern = 2;
+  bool same = true;
+  double library = 0;
+  double reference = 0;
+
+  for (uint32_t iteration = 0; iteration < number_of_iterations; iteration++) {
+    GenerateScan(&state, kOriginalRowWords, &input);
+    BitFlip target;
+    if (!kernels->find_first_bit_flip(input.results[default_pattern],
+          &target)) {
+      target.index = 0;
+      target.bit_offset = 0;
+      target.bit_mask = 1;
+    }
+
+    memcpy(&scan, &input, sizeof(scan));
+    double start = Now();
+    uint8_t target_pattern = kernels->compute_alternating_pattern(
+        &scan, target, default_pattern, &alter);
+    library += Now() - start;
+
+    for (uint32_t pattern = 0; pattern < kNumDataPatterns; pattern++) {
+      memcpy(results[pattern], input.results[pattern], sizeof(results[0]));
+    }
+    start = Now();
+    uint32_t reference_pattern = original::ComputeAlternatingPattern(
+        results, target.index, target.bit_offset, default_pattern,
+        first_alter, second_alter);
+    reference += Now() - start;
+
+    same = same && target_pattern == reference_pattern &&
+        SameAlternatingData(alter, first_alter, second_alter);
+  }
+
+  Report("ComputeAlternatingPattern", library, reference);
+  return same;
+}
+
+bool BenchmarkVerification() {
+  static PatternScan input;
+  uint64_t state = seed;
+  bool same = true;
+  double library = 0;
+  double reference = 0;
+
+  for (uint32_t iteration = 0; iteration < number_of_iterations; iteration++) {
+    GenerateScan(&state, kOriginalRowWords, &input);
+    for (uint32_t pattern = 0; pattern < kNumDataPatterns; pattern++) {
+      const uint64_t* results = input.results[pattern];
+
+      double start = Now();
+      BitFlip flip = {(uint32_t)-1, 0, 0};
+      uint32_t count = kernels->count_bit_flips(results);
+      if (count > 0) {
+        kernels->find_first_bit_flip(results, &flip);
+      }
+      library += Now() - start;
+
+      uint32_t target_index;
+      uint32_t target_bit_offset = 0;
+      start = Now();
+      uint32_t reference_count = original::CountBitFlips(results,
+          &target_index, &target_bit_offset);
+      reference += Now() - start;
+
+      same = same && count == reference_count &&
+          flip.index == target_index &&
+          (count == 0 || flip.bit_offset == target_bit_offset);
+    }
+  }
+
+  Report("Flip verification", library, reference);
+  return same;
+}
+
+// Encodes and decodes the per-cell signatures of the default
+// characterization pattern set and checks that they round trip.
+bool BenchmarkSignatures() {
+  static CharacterizationScan scan;
+  static PatternScan input;
+  std::vector<CharacterizationPattern> patterns;
+  std::vector<CellSignature> cells;
+  BuildCharacterizationPatterns(
+      "pinpoint,rowstripe,colstripe,checkerboard,random:4",
+      kOriginalRowWords, seed, &patterns);
+  uint32_t num_patterns = patterns.size();
+  uint64_t state = seed;
+  bool same = true;
+  double encode = 0;
+  double decode = 0;
+  uint64_t encoded_bytes = 0;
+
+  for (uint32_t iteration = 0; iteration < number_of_iterations; iteration++) {
+    for (uint32_t p = 0; p < num_patterns; p += kNumDataPatterns) {
+      GenerateScan(&state, kOriginalRowWords, &input);
+      for (uint32_t q = 0; q < kNumDataPatterns && p + q < num_patterns; q++) {
+        memcpy(scan.results[p+q], input.results[q], sizeof(scan.results[0]));
+      }
+    }
+
+    RowSignatures row;
+    double start = Now();
+    EncodeRowSignatures(scan, num_patterns, kOriginalRowWords, &row);
+    encode += Now() - start;
+    start = Now();
+    DecodeRowSignatures(row, num_patterns, &cells);
+    decode += Now() - start;
+    encoded_bytes += row.encoded.size();
+
+    same = same && cells.size() == row.num_cells;
+    for (const CellSignature& cell : cells) {
+      for (uint32_t p = 0; p < num_patterns; p++) {
+        same = same && ((scan.results[p][cell.bit / 64] >> (cell.bit % 64)) & 1)
+            == ((cell.signature >> p) & 1);
+      }
+    }
+  }
+
+  printf("[!] %-26s encode  %10.1f us/op  decode   %10.1f us/op  "
+      "(%lu bytes/row, %u raw)\n", "Cell signatures",
+      encode * 1e6 / number_of_iterations, decode * 1e6 / number_of_iterations,
+      encoded_bytes / number_of_iterations, num_patterns * 8*kOriginalRowWords);
+  return same;
+}
+
+// Writes and reads back a synthetic adjacency map in which every eighth row
+// pair is mirrored and some rows are quiet, and times triple lookups in it.
+bool BenchmarkAdjacencyMap() {
+  const uint64_t kRowsPerBank = 32768;
+  AdjacencyMap map;
+  AdjacencyMap loaded;
+  InitAdjacencyMap(kGeometryPresets[0], &map);
+  uint64_t state = seed;
+  for (uint32_t bank = 0; bank < map.num_banks; bank++) {
+    for (uint64_t row = 1; row + 1 < kRowsPerBank; row++) {
+      RowNeighbors neighbors = {-1, 1};
+      uint64_t random = NextRandom(&state);
+      if (random % 4 == 0) {
+        neighbors.first = 0;
+        neighbors.second = 0;
+      } else if (row % 8 == 3) {
+        neighbors.second = 2;
+      } else if (row % 8 == 5) {
+        neighbors.first = -2;
+      }
+      map.banks[bank][row] = neighbors;
+    }
+  }
+
+  char path[] = "/tmp/pinpoint_adjacencyXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  bool same = WriteAdjacencyMap(path, map) && ReadAdjacencyMap(path, &loaded);
+  FILE* file = fopen(path, "rb");
+  fseek(file, 0, SEEK_END);
+  long file_bytes = ftell(file);
+  fclose(file);
+  unlink(path);
+
+  uint64_t learned_rows = 0;
+  same = same && loaded.presumed_row_size == map.presumed_row_size &&
+      loaded.num_banks == map.num_banks;
+  for (uint32_t bank = 0; same && bank < map.num_banks; bank++) {
+    learned_rows += map.banks[bank].size();
+    same = loaded.banks[bank].size() == map.banks[bank].size();
+    for (const auto& entry : map.banks[bank]) {
+      const RowNeighbors& neighbors = loaded.banks[bank][entry.first];
+      same = same && neighbors.first == entry.second.first &&
+          neighbors.second == entry.second.second;
+    }
+  }
+
+  uint64_t lookups = 0;
+  uint64_t found = 0;
+  double start = Now();
+  for (uint32_t iteration = 0; iteration < number_of_iterations; iteration++) {
+    for (uint32_t bank = 0; bank < map.num_banks; bank++) {
+      for (uint64_t row = 0; row < kRowsPerBank; row++) {
+        uint64_t first_row, second_row;
+        found += FindAggressorRows(&loaded, bank, row, kRowsPerBank,
+            &first_row, &second_row);
+        lookups++;
+      }
+    }
+  }
+  double elapsed = Now() - start;
+
+  printf("[!] %-26s lookup  %10.3f us/op  file     %10.2f bytes/row  "
+      "(%lu of %lu rows hammered)\n", "Adjacency map",
+      elapsed * 1e6 / lookups, static_cast<double>(file_bytes) / learned_rows,
+      found / number_of_iterations, lookups / number_of_iterations);
+  return same;
+}
+
+// Simulated shard workers: each reports the keys of its own share plus the
+// multiples of seven, which every worker claims. The first worker to finish
+// a batch crashes once. A key flips key % 3 bits.
+const uint64_t kSimulatedKeys = 4096;
+std::atomic<uint32_t>* simulated_crashes;
+
+void SimulatedShardWorker(uint32_t shard, uint32_t num_shards, int socket) {
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < kSimulatedKeys; key++) {
+    if (key % num_shards == shard || key % 7 == 0) {
+      keys.push_back(key);
+    }
+  }
+  ShardMessage header = {kShardTriples, static_cast<uint32_t>(keys.size()),
+      0};
+  SendShardMessage(socket, header, keys);
+  while (ReceiveShardMessage(socket, &header, &keys) &&
+      header.type == kShardWork) {
+    if (simulated_crashes->fetch_add(1) == 0) {
+      abort();
+    }
+    ShardMessage result = {kShardResult, 0, 0};
+    for (uint64_t key : keys) {
+      result.bitflips += key % 3;
+    }
+    SendShardMessage(socket, result, std::vector<uint64_t>());
+  }
+}
+
+// Runs the coordinator with simulated workers and checks that every key is
+// hammered exactly once despite the crash.
+bool BenchmarkShards() {
+  const uint32_t kSimulatedShards = 4;
+  void* shared = mmap(NULL, sizeof(std::atomic<uint32_t>),
+      PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (shared == MAP_FAILED) {
+    return false;
+  }
+  simulated_crashes = new (shared) std::atomic<uint32_t>(0);
+
+  // Silence the coordinator and the crash while it runs.
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int saved_stderr = dup(STDERR_FILENO);
+  int null = open("/dev/null", O_WRONLY);
+  dup2(null, STDOUT_FILENO);
+  dup2(null, STDERR_FILENO);
+  ShardTotals totals;
+  double start = Now();
+  RunCoordinator(kSimulatedShards, &SimulatedShardWorker, NULL, &totals);
+  double elapsed = Now() - start;
+  fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  dup2(saved_stderr, STDERR_FILENO);
+  close(null);
+  close(saved_stdout);
+  close(saved_stderr);
+  munmap(shared, sizeof(std::atomic<uint32_t>));
+
+  uint64_t expected_bitflips = 0;
+  for (uint64_t key = 0; key < kSimulatedKeys; key++) {
+    expected_bitflips += key % 3;
+  }
+  printf("[!] %-26s %u shards  %9.1f us/triple  (%lu triples, "
+      "%u restarts)\n", "Shard coordinator", kSimulatedShards,
+      elapsed * 1e6 / totals.triples, totals.triples, totals.restarts);
+  return totals.triples == kSimulatedKeys &&
+      totals.bitflips == expected_bitflips && totals.restarts == 1;
+}
+
+// Calibrates a loop that takes kSimulatedReadSeconds per read and reports
+// the iterations per refresh window, and checks the budgets derived from the
+// expected rate.
+bool BenchmarkCalibration() {
+  const double kSimulatedReadSeconds = 50e-9;
+  std::function<void(uint64_t)> run =
+      [kSimulatedReadSeconds](uint64_t reads) {
+        double start = Now();
+        while (Now() - start < reads * kSimulatedReadSeconds) {
+        }
+      };
+  double tsc_hz = MeasureTscHz();
+  uint64_t iterations = CalibrateIterationsPerWindow(run, tsc_hz);
+  uint64_t expected = kRefreshWindowSeconds / kSimulatedReadSeconds;
+
+  bool capped;
+  HammerBudget fast = {0, 2};
+  HammerBudget slow = {expected / 4, 3};
+  HammerBudget too_many = {expected * 4, 1};
+  bool same = BudgetReads(fast, expected, &capped) == 2 * expected &&
+      !capped;
+  same = same && BudgetReads(slow, expected, &capped) == 3 * (expected / 4)
+      && !capped;
+  same = same && BudgetReads(too_many, expected, &capped) == expected &&
+      capped;
+
+  printf("[!] %-26s %10lu iterations/window  expected %10lu  "
+      "(TSC %.2f GHz)\n", "Refresh window calibration", iterations,
+      expected, tsc_hz * 1e-9);
+  // The measured rate is only reported; a busy machine slows the loop down.
+
+  // Pacing 2500 reads at 1000 per window needs three windows, so at least
+  // two full ones, however fast the loop is.
+  const uint64_t kPacedReads = 2500;
+  const uint64_t kPacedReadsPerWindow = 1000;
+  HammerPacing pacing = {kPacedReadsPerWindow,
+      static_cast<uint64_t>(tsc_hz * kRefreshWindowSeconds), 0, 0};
+  hammer_pacing = pacing;
+  uint64_t paced = 0;
+  uint64_t largest_chunk = 0;
+  double start = Now();
+  PacedReads(kPacedReads, [&paced, &largest_chunk](uint64_t reads) {
+    paced += reads;
+    largest_chunk = std::max(largest_chunk, reads);
+  });
+  double elapsed = Now() - start;
+  hammer_pacing.reads_per_window = 0;
+  printf("[!] %-26s %10lu reads in    %8.0f ms  (%lu per %.0f ms window)\n",
+      "Paced hammer loop", paced, elapsed * 1e3, kPacedReadsPerWindow,
+      kRefreshWindowSeconds * 1e3);
+  return same && paced == kPacedReads &&
+      largest_chunk <= kPacedReadsPerWindow &&
+      elapsed >= 2 * kRefreshWindowSeconds * 0.99;
+}
+
+// Simulated hammering for the pipeline benchmark: spins for
+// kSimulatedHammerSeconds and reports flips for every fourth triple. Each
+// triple has its own first, target and second row in simulated_rows, which
+// are never touched.
+const double kSimulatedHammerSeconds = 200e-6;
+const uint32_t kSimulatedTriples = 400;
+const uint8_t kSimulatedDefaultPattern = 2;
+// double_sided_rowhammer sets its victims to 0xFF, like pattern 6.
+const uint8_t kSimulatedDiscoveryPattern = 6;
+const uint8_t kSimulatedDiscoveryFill = 0xFF;
+double simulated_hammer_time;
+std::vector<uint64_t> simulated_rows;
+
+RowTriple SimulatedTriple(uint64_t triple) {
+  uint64_t* first_row = &simulated_rows[3 * triple * kOriginalRowWords];
+  RowTriple rows = {first_row, first_row + kOriginalRowWords,
+      first_row + 2 * kOriginalRowWords};
+  return rows;
+}
+
+uint64_t PatternSalt(const DataPattern& pattern) {
+  return pattern.first ^ (pattern.second << 1) ^ (pattern.target << 2);
+}
+
+void SimulateHammer(const RowTriple& rows, uint64_t salt, uint64_t* results) {
+  double start = Now();
+  while (Now() - start < kSimulatedHammerSeconds) {
+  }
+  uint64_t triple =
+      (rows.first_row - simulated_rows.data()) / (3 * kOriginalRowWords);
+  uint64_t state = seed ^ (triple * 0x9E3779B97F4A7C15ULL) ^ salt;
+  memset(results, 0, 8*kOriginalRowWords);
+  if (triple % 4 == 0) {
+    for (uint32_t flip = 0; flip < flips_per_row; flip++) {
+      uint64_t random = NextRandom(&state);
+      results[(random >> 8) % kOriginalRowWords] |= 1UL << (random & 63);
+    }
+  }
+  simulated_hammer_time += Now() - start;
+}
+
+void SimulatedHammerWithPattern(const RowTriple& rows,
+    const DataPattern& pattern, uint64_t number_of_reads, uint64_t* results) {
+  SimulateHammer(rows, PatternSalt(pattern), results);
+}
+
+// Cells only flip in one direction, so the flips depend on the target data.
+void SimulatedPinpointRowhammer(const RowTriple& rows, uint64_t target_data,
+    const AlternatingData& alter, uint64_t number_of_reads,
+    uint64_t* results) {
+  SimulateHammer(rows, 0x1234 ^ target_data, results);
+}
+
+// Made up page frames of a simulated triple: two pages per row.
+void SimulatedPageFrames(uint64_t triple, uint64_t page_frame_numbers[3]) {
+  for (uint32_t row = 0; row < 3; row++) {
+    page_frame_numbers[row] = 0x100000 + (3 * triple + row) * 2;
+  }
+}
+
+// Logs the flips of a simulated double_sided_rowhammer run over every
+// triple to path, one record per flipped target page.
+bool WriteSimulatedDiscovery(const char* path) {
+  static uint64_t results[kMaxRowWords];
+  FILE* file = fopen(path, "wb");
+  bool ok = file != NULL &&
+      WriteDiscoveryHeader(file, kSimulatedDiscoveryFill);
+  for (uint32_t triple = 0; ok && triple < kSimulatedTriples; triple++) {
+    SimulatedHammerWithPattern(SimulatedTriple(triple),
+        kDataPatterns[kSimulatedDiscoveryPattern], 0, results);
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(results);
+    for (uint32_t page = 0; ok && page < 8*kOriginalRowWords / 0x1000;
+        page++) {
+      DiscoveredVictim victim;
+      SimulatedPageFrames(triple, victim.page_frame_numbers);
+      victim.page_frame_numbers[1] += page;
+      victim.bank = 0;
+      for (uint32_t offset = 0; offset < 0x1000; offset++) {
+        uint8_t bits = bytes[page * 0x1000 + offset];
+        if (bits != 0) {
+          DiscoveredFlip flip = {static_cast<uint16_t>(offset), bits};
+          victim.flips.push_back(flip);
+        }
+      }
+      ok = victim.flips.empty() || WriteDiscoveredVictim(file, victim);
+    }
+  }
+  if (file != NULL) {
+    ok = fclose(file) == 0 && ok;
+  }
+  return ok;
+}
+
+// Builds the experiment of a simulated triple. With a discovery log, only
+// logged triples are built, targeting the logged flip.
+bool BuildSimulatedExperiment(uint64_t triple, const DiscoveryLog* log,
+    ExperimentInfo* info) {
+  memset(info, 0, sizeof(*info));
+  info->rows = SimulatedTriple(triple);
+  SimulatedPageFrames(triple, info->page_frame_numbers);
+  if (log == NULL) {
+    return true;
+  }
+  info->target_data = DiscoveredTargetData(*log);
+  return FindDiscoveredTarget(*log, info->page_frame_numbers, info->bank,
+      8*kOriginalRowWords, &info->target);
+}
+
+// Submits every simulated triple to pipeline, or only the logged ones with
+// a discovery log, and returns the share of time the hammer thread spent
+// hammering.
+double RunSimulatedPipeline(PinpointPipeline* pipeline,
+    const DiscoveryLog* log) {
+  // The analysis thread logs every row; keep that out of the report.
+  fflush(stdout);
+  int saved_stdout = dup(STDOUT_FILENO);
+  int null_fd = open("/dev/null", O_WRONLY);
+  dup2(null_fd, STDOUT_FILENO);
+
+  simulated_hammer_time = 0;
+  double start = Now();
+  std::thread analysis(RunAnalysis, pipeline);
+  for (uint32_t triple = 0; triple < kSimulatedTriples; triple++) {
+    ExperimentInfo info;
+    if (!BuildSimulatedExperiment(triple, log, &info)) {
+      continue;
+    }
+    if (log != NULL) {
+      SubmitDiscoveredTriple(pipeline, info);
+    } else {
+      SubmitTriple(pipeline, info);
+    }
+  }
+  FinishPipeline(pipeline);
+  double duty = simulated_hammer_time / (Now() - start);
+  analysis.join();
+
+  fflush(stdout);
+  dup2(saved_stdout, STDOUT_FILENO);
+  close(null_fd);
+  close(saved_stdout);
+  return duty;
+}
+
+// Runs kSimulatedTriples through the pipeline with simulated hammering and
+// reports the share of time the hammer thread spends hammering, against
+// running the same analysis inline as pinpoint_rowhammer used to. Then runs
+// the triples of a simulated double_sided_rowhammer flip log through the
+// two-stage pipeline, which must pinpoint them without detection runs.
+bool BenchmarkPipeline() {
+  static PatternScan scan;
+  static AlternatingData alter;
+  static WorkerTelemetry single_stage;
+  static WorkerTelemetry two_stage;
+  PinpointKernels simulated = *kernels;
+  simulated.hammer_with_pattern = &SimulatedHammerWithPattern;
+  simulated.pinpoint_rowhammer = &SimulatedPinpointRowhammer;
+  uint8_t default_pattern = kSimulatedDefaultPattern;
+  simulated_rows.assign(3 * kSimulatedTriples * kOriginalRowWords, 0);
+
+  // Inline analysis.
+  simulated_hammer_time = 0;
+  uint64_t inline_bitflips = 0;
+  double start = Now();
+  for (uint32_t triple = 0; triple < kSimulatedTriples; triple++) {
+    RowTriple rows = SimulatedTriple(triple);
+    simulated.hammer_with_pattern(rows, kDataPatterns[default_pattern], 0,
+        scan.results[default_pattern]);
+    if (simulated.count_bit_flips(scan.results[default_pattern]) == 0) {
+      continue;
+    }
+    BitFlip target;
+    simulated.find_first_bit_flip(scan.results[default_pattern], &target);
+    for (uint8_t pattern = 0; pattern < kNumDataPatterns; pattern++) {
+      simulated.hammer_with_pattern(rows, kDataPatterns[pattern], 0,
+          scan.results[pattern]);
+    }
+    simulated.compute_alternating_pattern(&scan, target, default_pattern,
+        &alter);
+    simulated.pinpoint_rowhammer(rows, 0, alter, 0, scan.results[0]);
+    inline_bitflips += simulated.count_bit_flips(scan.results[0]);
+  }
+  double inline_duty = simulated_hammer_time / (Now() - start);
+
+  PinpointPipeline* pipeline =
+      CreatePinpointPipeline(&simulated, default_pattern, 0);
+  pipeline->telemetry = &single_stage;
+  double pipeline_duty = RunSimulatedPipeline(pipeline, NULL);
+  printf("[!] %-26s inline  %9.1f%% hammering  pipeline %8.1f%% hammering"
+      "  (%ld CPUs)\n", "Hammer thread duty cycle", inline_duty * 100,
+      pipeline_duty * 100, sysconf(_SC_NPROCESSORS_ONLN));
+  bool same = pipeline->total_bitflips == inline_bitflips;
+  delete pipeline;
+
+  DiscoveryLog log;
+  char path[] = "/tmp/pinpoint_flipsXXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  same = same && WriteSimulatedDiscovery(path) && ReadDiscoveryLog(path, &log);
+  unlink(path);
+
+  // Pinpoint the logged triples inline, from the logged flip and data.
+  uint64_t discovered = 0;
+  uint64_t discovered_bitflips = 0;
+  for (uint32_t triple = 0; triple < kSimulatedTriples; triple++) {
+    ExperimentInfo info;
+    if (!BuildSimulatedExperiment(triple, &log, &info)) {
+      continue;
+    }
+    discovered++;
+    for (uint8_t pattern = 0; pattern < kNumDataPatterns; pattern++) {
+      simulated.hammer_with_pattern(info.rows, kDataPatterns[pattern], 0,
+          scan.results[pattern]);
+    }
+    simulated.compute_alternating_pattern(&scan, info.target,
+        default_pattern, &alter);
+    simulated.pinpoint_rowhammer(info.rows, info.target_data, alter, 0,
+        scan.results[0]);
+    discovered_bitflips += simulated.count_bit_flips(scan.results[0]);
+  }
+
+  pipeline = CreatePinpointPipeline(&simulated, default_pattern, 0);
+  pipeline->telemetry = &two_stage;
+  RunSimulatedPipeline(pipeline, &log);
+  printf("[!] %-26s single  %9lu runs      two-stage %7lu runs\n",
+      "Pinpoint stage", single_stage.hammer_runs.load(),
+      two_stage.hammer_runs.load());
+  same = same && discovered == kSimulatedTriples / 4 &&
+      pipeline->total_bitflips == discovered_bitflips &&
+      two_stage.triples_done == discovered &&
+      two_stage.hammer_runs == discovered * (kNumDataPatterns + 1);
+  delete pipeline;
+  return same;
+}
+
+// Times the alternating pattern kernel of every instantiated row geometry.
+void BenchmarkGeometries() {
+  static PatternScan input;
+  static PatternScan scan;
+  static AlternatingData alter;
+
+  for (uint32_t i = 0; i < kNumPinpointKernels; i++) {
+    const PinpointKernels& geometry_kernels = kPinpointKernels[i];
+    uint64_t state = seed;
+    double elapsed = 0;
+    for (uint32_t iteration = 0; iteration < number_of_iterations;
+        iteration++) {
+      GenerateScan(&state, geometry_kernels.row_words, &input);
+      BitFlip target = {0, 0, 1};
+      geometry_kernels.find_first_bit_flip(input.results[2], &target);
+      memcpy(&scan, &input, sizeof(scan));
+      double start = Now();
+      geometry_kernels.compute_alternating_pattern(&scan, target, 2, &alter);
+      elapsed += Now() - start;
+    }
+    printf("[!] %5u-byte rows: ComputeAlternatingPattern %10.1f us/op\n",
+        geometry_kernels.row_bytes, elapsed * 1e6 / number_of_iterations);
+  }
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  int opt;
+  while ((opt = getopt(argc, argv, "i:f:s:")) != -1) {
+    switch (opt) {
+      case 'i':
+        number_of_iterations = atoi(optarg);
+        break;
+      case 'f':
+        flips_per_row = atoi(optarg);
+        break;
+      case 's':
+        seed = strtoull(optarg, NULL, 0);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-i iterations] [-f flips] [-s seed]\n",
+            argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (number_of_iterations == 0 || seed == 0) {
+    fprintf(stderr, "[-] Iterations and seed must be non-zero\n");
+    exit(EXIT_FAILURE);
+  }
+
+  printf("[!] %u iterations, %u flips per row, seed %lx\n",
+      number_of_iterations, flips_per_row, seed);
+
+  DramGeometry original_geometry = kGeometryPresets[0];
+  original_geometry.row_bytes = 8*kOriginalRowWords;
+  kernels = SelectKernels(original_geometry);
+
+  bool same = true;
+  same = BenchmarkComputePinpointData() && same;
+  same = BenchmarkAlternatingPattern() && same;
+  same = BenchmarkVerification() && same;
+  same = BenchmarkSignatures() && same;
+  same = BenchmarkAdjacencyMap() && same;
+  same = BenchmarkPipeline() && same;
+  same = BenchmarkShards() && same;
+  same = BenchmarkCalibration() && same;
+  BenchmarkGeometries();
+
+  if (!same) {
+    printf("[-] Library results differ from the original implementation\n");
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
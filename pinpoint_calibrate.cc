@@ -0,0 +1,94 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_calibrate.h"
+
+#include <algorithm>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+HammerPacing hammer_pacing = {0, 0, 0, 0};
+
+namespace {
+
+double MonotonicSeconds() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+}  // namespace
+
+double MeasureTscHz() {
+  double start = MonotonicSeconds();
+  uint64_t start_tsc = ReadTsc();
+  double now;
+  while ((now = MonotonicSeconds()) - start < 0.02) {
+  }
+  return (ReadTsc() - start_tsc) / (now - start);
+}
+
+uint64_t CalibrateIterationsPerWindow(
+    const std::function<void(uint64_t)>& run,
+    double tsc_hz) {
+  // Time the loop at its own rate.
+  HammerPacing pacing = hammer_pacing;
+  hammer_pacing.reads_per_window = 0;
+  std::vector<uint64_t> ticks;
+  for (uint32_t i = 0; i < kCalibrationRuns; i++) {
+    uint64_t start = ReadTsc();
+    run(kCalibrationReads);
+    ticks.push_back(ReadTsc() - start);
+  }
+  hammer_pacing = pacing;
+  std::sort(ticks.begin(), ticks.end());
+  double seconds = ticks[kCalibrationRuns / 2] / tsc_hz;
+  return kCalibrationReads * kRefreshWindowSeconds / seconds;
+}
+
+uint64_t BudgetReads(const HammerBudget& budget,
+    uint64_t iterations_per_window, bool* capped) {
+  uint64_t per_window = iterations_per_window;
+  *capped = false;
+  if (budget.activations_per_window > 0) {
+    *capped = budget.activations_per_window > iterations_per_window;
+    per_window = std::min(budget.activations_per_window,
+        iterations_per_window);
+  }
+  return per_window * budget.windows;
+}
+
+uint64_t CalibrateBudget(const char* kernel_name,
+    const std::function<void(uint64_t)>& run, const HammerBudget& budget) {
+  double tsc_hz = MeasureTscHz();
+  uint64_t iterations_per_window = CalibrateIterationsPerWindow(run, tsc_hz);
+  bool capped;
+  uint64_t reads = BudgetReads(budget, iterations_per_window, &capped);
+  // Every kernel reads each aggressor once per iteration, so the pacing is
+  // the same for all of them; a capped kernel never reaches it.
+  hammer_pacing.reads_per_window = budget.activations_per_window;
+  hammer_pacing.ticks_per_window = tsc_hz * kRefreshWindowSeconds;
+
+  printf("[!] %s: %lu iterations per %.0f ms refresh window (TSC %.2f GHz)\n",
+      kernel_name, iterations_per_window, kRefreshWindowSeconds * 1e3,
+      tsc_hz * 1e-9);
+  if (capped) {
+    printf("[-] %lu activations per window is more than this kernel "
+        "reaches, hammering at its rate\n", budget.activations_per_window);
+  }
+  printf("[!] %lu reads per experiment, over %u windows (~%.0f ms)\n",
+      reads, budget.windows, 1e3 * budget.windows * kRefreshWindowSeconds);
+  return reads;
+}
@@ -0,0 +1,114 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Hammer budgets in activations per refresh window.
+//
+// A fixed number of reads takes very different times on different CPUs and
+// memory, and so spans a different number of refresh windows. Instead, the
+// hammer loop of the selected kernel is timed with rdtscp, which gives the
+// iterations (one activation of each aggressor) it reaches per 64 ms window,
+// and an experiment asks for a number of activations per window over a
+// number of windows. BudgetReads() turns that into the read count the
+// kernels take, never running longer than the requested windows, and the
+// hammer loops issue their reads through PacedReads(), which spreads them
+// over the windows.
+
+#ifndef PINPOINT_CALIBRATE_H_
+#define PINPOINT_CALIBRATE_H_
+
+#include <algorithm>
+#include <functional>
+#include <stdint.h>
+
+const double kRefreshWindowSeconds = 0.064;
+
+// Reads issued per calibration run, and the number of runs whose median is
+// taken.
+const uint64_t kCalibrationReads = 200000;
+const uint32_t kCalibrationRuns = 5;
+
+inline uint64_t ReadTsc() {
+  uint32_t low, high, aux;
+  asm volatile("rdtscp" : "=a" (low), "=d" (high), "=c" (aux) :: "memory");
+  return (static_cast<uint64_t>(high) << 32) | low;
+}
+
+// TSC ticks per second, measured against CLOCK_MONOTONIC.
+double MeasureTscHz();
+
+// Hammer iterations per refresh window of run, which issues the given
+// number of reads.
+uint64_t CalibrateIterationsPerWindow(
+    const std::function<void(uint64_t)>& run,
+    double tsc_hz);
+
+struct HammerBudget {
+  // Activations of each aggressor per refresh window; 0 hammers as fast as
+  // the kernel goes.
+  uint64_t activations_per_window;
+  uint32_t windows;
+};
+
+// Reads for budget at the calibrated rate. Sets *capped if the kernel is too
+// slow for the requested activations per window.
+uint64_t BudgetReads(const HammerBudget& budget,
+    uint64_t iterations_per_window, bool* capped);
+
+// Pacing state of the hammer loops of this process. Only the hammer thread
+// hammers, so it is not synchronized.
+struct HammerPacing {
+  // Reads allowed per refresh window; 0 runs the loops unpaced.
+  uint64_t reads_per_window;
+  uint64_t ticks_per_window;
+  // The refresh window being filled, and the reads issued in it.
+  uint64_t window_start;
+  uint64_t window_reads;
+};
+
+extern HammerPacing hammer_pacing;
+
+// Issues reads reads with run(count), in chunks that keep every refresh
+// window at or below hammer_pacing.reads_per_window. Once a window is full,
+// waits for the next one.
+template <typename Run>
+inline void PacedReads(uint64_t reads, const Run& run) {
+  HammerPacing& pacing = hammer_pacing;
+  if (pacing.reads_per_window == 0) {
+    run(reads);
+    return;
+  }
+  while (reads > 0) {
+    uint64_t now = ReadTsc();
+    if (now - pacing.window_start >= pacing.ticks_per_window) {
+      pacing.window_start = now;
+      pacing.window_reads = 0;
+    }
+    if (pacing.window_reads == pacing.reads_per_window) {
+      asm volatile("pause" ::: "memory");
+      continue;
+    }
+    uint64_t chunk =
+        std::min(reads, pacing.reads_per_window - pacing.window_reads);
+    run(chunk);
+    pacing.window_reads += chunk;
+    reads -= chunk;
+  }
+}
+
+// Calibrates run unpaced, prints the result, paces the hammer loops to the
+// activations per window of budget and returns the reads for budget.
+uint64_t CalibrateBudget(const char* kernel_name,
+    const std::function<void(uint64_t)>& run, const HammerBudget& budget);
+
+#endif  // PINPOINT_CALIBRATE_H_
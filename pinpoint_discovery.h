@@ -0,0 +1,82 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Flip log of double-sided Rowhammer discovery.
+//
+// double_sided_rowhammer -o records every target row page that flipped,
+// along with the aggressor pages and the flipped bytes. pinpoint_rowhammer
+// -d only runs the Pinpoint stage on triples whose target row contains a
+// logged page that flipped with the same bank and aggressor rows, starting
+// from the logged flip. Detection is skipped. Both runs see physical pages,
+// so only the triples both happened to map are pinpointed.
+//
+// Log file layout (little endian):
+//   "PPFLIP1\0"
+//   uint8 fill (the byte every victim page was set to)
+//   victims: {uint64 pfn[3] (first, victim page, second), uint8 bank,
+//             uint32 num_flips, num_flips x {uint16 offset, uint8 bits}}
+// offset is the byte offset in the victim page and bits the flipped bits of
+// that byte.
+
+#ifndef PINPOINT_DISCOVERY_H_
+#define PINPOINT_DISCOVERY_H_
+
+#include <map>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+#include "pinpoint_module.h"
+
+struct DiscoveredFlip {
+  uint16_t offset;
+  uint8_t bits;
+};
+
+struct DiscoveredVictim {
+  uint64_t page_frame_numbers[3];
+  uint8_t bank;
+  std::vector<DiscoveredFlip> flips;
+};
+
+struct DiscoveryLog {
+  uint8_t fill;
+  // Keyed by the victim page frame number. Only the first record of a page
+  // is kept.
+  std::map<uint64_t, DiscoveredVictim> victims;
+};
+
+// Writes the log header, followed by victims written with
+// WriteDiscoveredVictim(). Returns false on I/O errors.
+bool WriteDiscoveryHeader(FILE* file, uint8_t fill);
+bool WriteDiscoveredVictim(FILE* file, const DiscoveredVictim& victim);
+
+// Reads a whole log written by the functions above. A truncated last victim
+// is dropped.
+bool ReadDiscoveryLog(const char* path, DiscoveryLog* log);
+
+// Looks for a logged page in the target row of the triple that flipped in
+// bank when hammering pages of its aggressor rows, and sets target to its
+// first flip, relative to the row. page_frame_numbers are the first pages
+// of the row_bytes long rows, as set by BuildRowTriple(). Returns false if
+// the log has no such page.
+bool FindDiscoveredTarget(const DiscoveryLog& log,
+    const uint64_t page_frame_numbers[3], uint8_t bank, uint64_t row_bytes,
+    BitFlip* target);
+
+// The data the target row held when it flipped: fill in every byte.
+inline uint64_t DiscoveredTargetData(const DiscoveryLog& log) {
+  return 0x0101010101010101UL * log.fill;
+}
+
+#endif  // PINPOINT_DISCOVERY_H_
@@ -0,0 +1,53 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_geometry.h"
+
+#include <string.h>
+
+// {name, row_bytes, num_banks, page_bytes, cache_line_bytes}
+const DramGeometry kGeometryPresets[] = {
+  // DDR3, 1 rank, 8 banks: 64 KiB presumed rows.
+  {"ddr3", 0x2000, 8, 0x1000, 64},
+  // DDR4, 1 rank, 16 banks: 128 KiB presumed rows.
+  {"ddr4", 0x2000, 16, 0x1000, 64},
+  // DDR5 x8, one 32-bit subchannel, 32 banks: 4 KiB rows.
+  {"ddr5", 0x1000, 32, 0x1000, 64},
+  // The same geometries backed by 2 MiB huge pages, which keeps every row
+  // physically contiguous.
+  {"ddr3-2m", 0x2000, 8, 0x200000, 64},
+  {"ddr4-2m", 0x2000, 16, 0x200000, 64},
+  {"ddr5-2m", 0x1000, 32, 0x200000, 64},
+};
+
+const uint32_t kNumGeometryPresets =
+    sizeof(kGeometryPresets) / sizeof(kGeometryPresets[0]);
+
+const DramGeometry* FindGeometry(const char* name) {
+  for (uint32_t i = 0; i < kNumGeometryPresets; i++) {
+    if (strcmp(kGeometryPresets[i].name, name) == 0) {
+      return &kGeometryPresets[i];
+    }
+  }
+  return NULL;
+}
+
+void PrintGeometryPresets(FILE* stream) {
+  for (uint32_t i = 0; i < kNumGeometryPresets; i++) {
+    const DramGeometry& geometry = kGeometryPresets[i];
+    fprintf(stream, "  %-8s %5u-byte rows, %2u banks, %7u-byte pages\n",
+        geometry.name, geometry.row_bytes, geometry.num_banks,
+        geometry.page_bytes);
+  }
+}
@@ -0,0 +1,72 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Row, bank, page and cache line geometry of the tested DRAM.
+//
+// RowGeometry fixes the geometry at compile time so that the kernels in
+// pinpoint_module.cc get constant loop bounds. DramGeometry is the runtime
+// description chosen on the command line; SelectKernels() in
+// pinpoint_module.h maps it to a matching instantiation.
+
+#ifndef PINPOINT_GEOMETRY_H_
+#define PINPOINT_GEOMETRY_H_
+
+#include <stdint.h>
+#include <stdio.h>
+
+template <uint32_t RowBytes, uint32_t CacheLineBytes = 64>
+struct RowGeometry {
+  static_assert((RowBytes & (RowBytes - 1)) == 0,
+      "row size must be a power of two");
+  static_assert(RowBytes % CacheLineBytes == 0,
+      "row size must be a multiple of the cache line size");
+
+  // Bytes of a row that belong to one bank.
+  static constexpr uint32_t kRowBytes = RowBytes;
+  static constexpr uint32_t kRowWords = RowBytes / sizeof(uint64_t);
+  static constexpr uint32_t kCacheLineBytes = CacheLineBytes;
+  static constexpr uint32_t kCacheLineWords =
+      CacheLineBytes / sizeof(uint64_t);
+};
+
+// The largest row any instantiated kernel works on (16 KiB).
+const uint32_t kMaxRowWords = 2048;
+
+struct DramGeometry {
+  const char* name;
+  // Bytes of a row that belong to one bank.
+  uint32_t row_bytes;
+  uint32_t num_banks;
+  // Size of the pages backing the test mapping.
+  uint32_t page_bytes;
+  uint32_t cache_line_bytes;
+};
+
+// Named geometries selectable with -g. The first entry is the default and
+// matches the bank bits described in README.md.
+extern const DramGeometry kGeometryPresets[];
+extern const uint32_t kNumGeometryPresets;
+
+// Returns the preset called name, or NULL if there is none.
+const DramGeometry* FindGeometry(const char* name);
+
+// Bytes spanned by one row across all banks
+// (physical_address / presumed_row_size gives the row index).
+inline uint64_t PresumedRowSize(const DramGeometry& geometry) {
+  return static_cast<uint64_t>(geometry.row_bytes) * geometry.num_banks;
+}
+
+void PrintGeometryPresets(FILE* stream);
+
+#endif  // PINPOINT_GEOMETRY_H_
@@ -0,0 +1,174 @@
+// Copyright 2015, Google, Inc.
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Memory mapping and physical row indexing, split out of
+// double_sided_rowhammer.cc and pinpoint_rowhammer.cc.
+//
+// Original author: Thomas Dullien (thomasdullien@google.com)
+// Modified author: Sangwoo Ji (sangwooji@postech.edu)
+
+#include "pinpoint_memory.h"
+
+#include <assert.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+#include <unistd.h>
+#include "pinpoint_calibrate.h"
+
+uint64_t GetPhysicalMemorySize() {
+  struct sysinfo info;
+  sysinfo( &info );
+  return (size_t)info.totalram * (size_t)info.mem_unit;
+}
+
+uint64_t GetPageFrameNumber(int pagemap, uint8_t* virtual_address) {
+  // Read the entry in the pagemap.
+  uint64_t value;
+  int got = pread(pagemap, &value, 8,
+                  (reinterpret_cast<uintptr_t>(virtual_address) / 0x1000) * 8);
+  assert(got == 8);
+  uint64_t page_frame_number = value & ((1ULL << 54)-1);
+  return page_frame_number;
+}
+
+void SetupMapping(
+    double fraction_of_physical_memory,
+    uint32_t page_bytes,
+    uint64_t* mapping_size,
+    void** mapping) {
+  *mapping_size =
+    static_cast<uint64_t>((static_cast<double>(GetPhysicalMemorySize()) *
+          fraction_of_physical_memory));
+  int flags = MAP_POPULATE | MAP_ANONYMOUS | MAP_PRIVATE;
+  if (page_bytes > 0x1000) {
+    // Huge pages must be mapped in whole pages.
+    *mapping_size -= *mapping_size % page_bytes;
+    flags |= MAP_HUGETLB;
+  }
+
+  *mapping = mmap(NULL, *mapping_size, PROT_READ | PROT_WRITE,
+      flags, -1, 0);
+  assert(*mapping != (void*)-1);
+
+  // Initialize the mapping so that the pages are non-empty.
+  printf("[!] Initializing large memory mapping ...");
+  for (uint64_t index = 0; index < *mapping_size; index += 0x1000) {
+    uint64_t* temporary = reinterpret_cast<uint64_t*>(
+        static_cast<uint8_t*>(*mapping) + index);
+    temporary[0] = index;
+  }
+  printf("done\n");
+}
+
+uint8_t GetPresumedBankNumber(
+    uint64_t page_frame_number,
+    const DramGeometry& geometry) {
+  uint64_t pa = page_frame_number << 12;
+  uint64_t bank_mask = geometry.num_banks - 1;
+  uint8_t presumed_bank_num = ((pa / geometry.row_bytes) & bank_mask) ^
+      ((pa / PresumedRowSize(geometry)) & bank_mask);
+
+  return presumed_bank_num;
+}
+
+void BuildRowIndex(
+    int pagemap,
+    void* memory_mapping,
+    uint64_t memory_mapping_size,
+    uint64_t presumed_row_size,
+    RowIndex* pages_per_row) {
+  pages_per_row->clear();
+  pages_per_row->resize(memory_mapping_size / presumed_row_size);
+
+  printf("[!] Identifying rows for accessible pages ... ");
+  for (uint64_t offset = 0; offset < memory_mapping_size; offset += 0x1000) {
+    uint8_t* virtual_address = static_cast<uint8_t*>(memory_mapping) + offset;
+    uint64_t page_frame_number = GetPageFrameNumber(pagemap, virtual_address);
+    uint64_t physical_address = page_frame_number * 0x1000;
+    uint64_t presumed_row_index = physical_address / presumed_row_size;
+    if (presumed_row_index >= pages_per_row->size()) {
+      pages_per_row->resize(presumed_row_index + 1);
+    }
+    MappedPage page = {virtual_address, page_frame_number};
+    (*pages_per_row)[presumed_row_index].push_back(page);
+  }
+  printf("Done\n");
+}
+
+void GroupPagesByBank(
+    const std::vector<MappedPage>& row,
+    const DramGeometry& geometry,
+    std::vector<std::vector<MappedPage>>* pages_per_bank) {
+  pages_per_bank->clear();
+  pages_per_bank->resize(geometry.num_banks);
+  for (const MappedPage& page : row) {
+    uint8_t bank = GetPresumedBankNumber(page.page_frame_number, geometry);
+    (*pages_per_bank)[bank].push_back(page);
+  }
+}
+
+const MappedPage* FindRowInBank(
+    const std::vector<MappedPage>& row,
+    uint8_t bank,
+    const DramGeometry& geometry) {
+  uint64_t pages_per_bank_row = geometry.row_bytes / 0x1000;
+  if (pages_per_bank_row == 0) {
+    pages_per_bank_row = 1;
+  }
+  for (uint64_t i = 0; i + pages_per_bank_row <= row.size(); i++) {
+    const MappedPage& page = row[i];
+    if ((page.page_frame_number % pages_per_bank_row) != 0 ||
+        GetPresumedBankNumber(page.page_frame_number, geometry) != bank) {
+      continue;
+    }
+    // Pages of a bucket are in virtual address order, so the rest of the row
+    // has to follow immediately.
+    uint64_t next = 1;
+    while (next < pages_per_bank_row &&
+        row[i+next].virtual_address == page.virtual_address + next*0x1000 &&
+        row[i+next].page_frame_number == page.page_frame_number + next) {
+      next++;
+    }
+    if (next == pages_per_bank_row) {
+      return &page;
+    }
+  }
+  return NULL;
+}
+
+uint64_t HammerAddressesStandard(
+    const std::pair<uint64_t, uint64_t>& first_range,
+    const std::pair<uint64_t, uint64_t>& second_range,
+    uint64_t number_of_reads) {
+  volatile uint64_t* first_pointer =
+      reinterpret_cast<uint64_t*>(first_range.first);
+  volatile uint64_t* second_pointer =
+      reinterpret_cast<uint64_t*>(second_range.first);
+  uint64_t sum = 0;
+
+  PacedReads(number_of_reads,
+      [first_pointer, second_pointer, &sum](uint64_t reads) {
+        while (reads-- > 0) {
+          sum += first_pointer[0];
+          sum += second_pointer[0];
+          asm volatile(
+              "clflush (%0);\n\t"
+              "clflush (%1);\n\t"
+              : : "r" (first_pointer), "r" (second_pointer) : "memory");
+        }
+      });
+  return sum;
+}
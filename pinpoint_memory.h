@@ -0,0 +1,87 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Memory mapping and physical row indexing shared by the rowhammer drivers.
+
+#ifndef PINPOINT_MEMORY_H_
+#define PINPOINT_MEMORY_H_
+
+#include <stdint.h>
+#include <utility>
+#include <vector>
+#include "pinpoint_geometry.h"
+
+// A page of the test mapping together with its physical page frame number,
+// resolved once while indexing so later stages do not re-read the pagemap.
+struct MappedPage {
+  uint8_t* virtual_address;
+  uint64_t page_frame_number;
+};
+
+// All mapped pages, bucketed by presumed row index
+// (physical_address / presumed_row_size).
+typedef std::vector<std::vector<MappedPage>> RowIndex;
+
+// Obtain the size of the physical memory of the system.
+uint64_t GetPhysicalMemorySize();
+
+uint64_t GetPageFrameNumber(int pagemap, uint8_t* virtual_address);
+
+// Maps and touches fraction_of_physical_memory of the system memory, backed
+// by pages of page_bytes.
+void SetupMapping(
+    double fraction_of_physical_memory,
+    uint32_t page_bytes,
+    uint64_t* mapping_size,
+    void** mapping);
+
+// The bank index bits above the row offset xor the same number of bits above
+// the presumed row. For the "ddr3" geometry these are 14th xor 17th,
+// 15th xor 18th and 16th xor 19th.
+uint8_t GetPresumedBankNumber(
+    uint64_t page_frame_number,
+    const DramGeometry& geometry);
+
+void BuildRowIndex(
+    int pagemap,
+    void* memory_mapping,
+    uint64_t memory_mapping_size,
+    uint64_t presumed_row_size,
+    RowIndex* pages_per_row);
+
+// Splits the pages of a row by presumed bank; (*pages_per_bank)[bank] keeps
+// the pages of that bank in their original order.
+void GroupPagesByBank(
+    const std::vector<MappedPage>& row,
+    const DramGeometry& geometry,
+    std::vector<std::vector<MappedPage>>* pages_per_bank);
+
+// Returns the first page of row that starts a physically contiguous,
+// row_bytes-aligned part of the row in bank, or NULL if there is none.
+const MappedPage* FindRowInBank(
+    const std::vector<MappedPage>& row,
+    uint8_t bank,
+    const DramGeometry& geometry);
+
+uint64_t HammerAddressesStandard(
+    const std::pair<uint64_t, uint64_t>& first_range,
+    const std::pair<uint64_t, uint64_t>& second_range,
+    uint64_t number_of_reads);
+
+typedef uint64_t(HammerFunction)(
+    const std::pair<uint64_t, uint64_t>& first_range,
+    const std::pair<uint64_t, uint64_t>& second_range,
+    uint64_t number_of_reads);
+
+#endif  // PINPOINT_MEMORY_H_
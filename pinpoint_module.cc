@@ -25,52 +25,65 @@
 
 #include "pinpoint_module.h"
 
+#include "pinpoint_calibrate.h"
+
 #define ZERO 0x0000000000000000UL
 #define ONE 0xffffffffffffffffUL
 
-uint64_t first_data[8] ={ZERO, ZERO, ONE, ONE, ZERO, ZERO, ONE, ONE};
-uint64_t target_data[8]={ZERO, ZERO, ZERO, ZERO, ONE, ONE, ONE, ONE};
-uint64_t second_data[8]={ZERO, ONE, ONE, ZERO, ZERO, ONE, ONE, ZERO};
+// {first, target, second}
+const DataPattern kDataPatterns[kNumDataPatterns] = {
+  {ZERO, ZERO, ZERO},
+  {ZERO, ZERO, ONE},
+  {ONE, ZERO, ONE},
+  {ONE, ZERO, ZERO},
+  {ZERO, ONE, ZERO},
+  {ZERO, ONE, ONE},
+  {ONE, ONE, ONE},
+  {ONE, ONE, ZERO},
+};
+
+namespace {
+
+// Writes the aggressor data of pattern into the bits of bit_mask for one
+// phase.
+inline void SetPhasePattern(
+    AlternatingData* alter,
+    uint8_t phase,
+    uint8_t pattern,
+    uint32_t index,
+    uint64_t bit_mask) {
+  uint64_t& first = alter->first_alter[phase][index];
+  uint64_t& second = alter->second_alter[phase][index];
+  first = (first&(~bit_mask))|(kDataPatterns[pattern].first&bit_mask);
+  second = (second&(~bit_mask))|(kDataPatterns[pattern].second&bit_mask);
+}
 
 void AlternateOnePattern(
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
+    AlternatingData* alter,
     uint8_t pattern,
     uint32_t index,
     uint64_t bit_mask) {
 
     for (uint8_t i=0; i<12; i++) {
-      first_alter[i][index] = (first_alter[i][index]&(~bit_mask))|
-          (first_data[pattern]&bit_mask);
-      second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
-          (second_data[pattern]&bit_mask);
+      SetPhasePattern(alter, i, pattern, index, bit_mask);
     }
 }
- 
+
 void AlternateTwoPatterns(
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
+    AlternatingData* alter,
     uint8_t first_pattern,
     uint8_t second_pattern,
     uint32_t index,
     uint64_t bit_mask) {
 
     for (uint8_t i=0; i<12; i+=2) {
-      first_alter[i][index] = (first_alter[i][index]&(~bit_mask))|
-          (first_data[first_pattern]&bit_mask);
-      second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
-          (second_data[first_pattern]&bit_mask);
-
-      first_alter[i+1][index] = (first_alter[i+1][index]&(~bit_mask))|
-          (first_data[second_pattern]&bit_mask);
-      second_alter[i+1][index] = (second_alter[i+1][index]&(~bit_mask))|
-          (second_data[second_pattern]&bit_mask);
+      SetPhasePattern(alter, i, first_pattern, index, bit_mask);
+      SetPhasePattern(alter, i+1, second_pattern, index, bit_mask);
     }
 }
 
 void AlternateThreePatterns(
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
+    AlternatingData* alter,
     uint8_t first_pattern,
     uint8_t second_pattern,
     uint8_t third_pattern,
@@ -78,108 +91,236 @@ void AlternateThreePatterns(
     uint64_t bit_mask) {
 
     for (uint8_t i=0; i<12; i+=3) {
-      first_alter[i][index] = (first_alter[i][index]&(~bit_mask))|
-          (first_data[first_pattern]&bit_mask);
-      second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
-          (second_data[first_pattern]&bit_mask);
-
-      first_alter[i+1][index] = (first_alter[i+1][index]&(~bit_mask))|
-          (first_data[second_pattern]&bit_mask);
-      second_alter[i+1][index] = (second_alter[i+1][index]&(~bit_mask))|
-          (second_data[second_pattern]&bit_mask);
-
-      first_alter[i+2][index] = (first_alter[i+2][index]&(~bit_mask))|
-          (first_data[third_pattern]&bit_mask);
-      second_alter[i+2][index] = (second_alter[i+2][index]&(~bit_mask))|
-          (second_data[third_pattern]&bit_mask);
+      SetPhasePattern(alter, i, first_pattern, index, bit_mask);
+      SetPhasePattern(alter, i+1, second_pattern, index, bit_mask);
+      SetPhasePattern(alter, i+2, third_pattern, index, bit_mask);
     }
 }
 
 void AlternateFourPatterns(
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024], 
+    AlternatingData* alter,
     uint32_t index,
     uint64_t bit_mask) {
 
     for (uint8_t i=0; i<12; i++) {
-      first_alter[i][index] = ((first_alter[i][index]&(~bit_mask))|
-          (first_data[i%4]&bit_mask));
-      second_alter[i][index] = (second_alter[i][index]&(~bit_mask))|
-          (second_data[i%4]&bit_mask);
+      SetPhasePattern(alter, i, i%4, index, bit_mask);
     }
-}  
+}
+
+// If the target bit is vulnerable to multiple data patterns, choose one of
+// them empirically.
+uint8_t ChooseTargetPattern(uint8_t flip_results, uint8_t default_pattern) {
+  switch (flip_results) {
+    case 0b0010:
+    case 0b0011:
+    case 0b0110:
+    case 0b0111:
+    case 0b1010:
+    case 0b1011:
+    case 0b1110:
+    case 0b1111:
+      return 2;
+    case 0b1000:
+    case 0b1001:
+    case 0b1100:
+    case 0b1101:
+      return 0;
+    case 0b0001:
+    case 0b0101:
+      return 3;
+    case 0b0100:
+      return 1;
+  }
+  return default_pattern;
+}
+
+}  // namespace
 
 void ComputePinpointData(
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
+    AlternatingData* alter,
     uint32_t index,
     uint64_t bit_mask,
     uint8_t flip_results) {
   switch (flip_results) {
     case 0b0000:
     case 0b1111:
-      AlternateFourPatterns(first_alter, second_alter, index, bit_mask);
+      AlternateFourPatterns(alter, index, bit_mask);
       break;
     case 0b0001:
-      AlternateThreePatterns(first_alter, second_alter, 0, 1, 2, index, bit_mask);
+      AlternateThreePatterns(alter, 0, 1, 2, index, bit_mask);
       break;
     case 0b0010:
-      AlternateThreePatterns(first_alter, second_alter, 0, 1, 3, index, bit_mask);
+      AlternateThreePatterns(alter, 0, 1, 3, index, bit_mask);
       break;
     case 0b0100:
-      AlternateThreePatterns(first_alter, second_alter, 0, 2, 3, index, bit_mask);
+      AlternateThreePatterns(alter, 0, 2, 3, index, bit_mask);
       break;
     case 0b1000:
-      AlternateThreePatterns(first_alter, second_alter, 1, 2, 3, index, bit_mask);
+      AlternateThreePatterns(alter, 1, 2, 3, index, bit_mask);
       break;
     case 0b0011:
-      AlternateTwoPatterns(first_alter, second_alter, 0, 1, index, bit_mask);
+      AlternateTwoPatterns(alter, 0, 1, index, bit_mask);
       break;
     case 0b0101:
-      AlternateTwoPatterns(first_alter, second_alter, 0, 2, index, bit_mask);
+      AlternateTwoPatterns(alter, 0, 2, index, bit_mask);
       break;
     case 0b0110:
-      AlternateTwoPatterns(first_alter, second_alter, 0, 3, index, bit_mask);
+      AlternateTwoPatterns(alter, 0, 3, index, bit_mask);
       break;
     case 0b1001:
-      AlternateTwoPatterns(first_alter, second_alter, 1, 2, index, bit_mask);
+      AlternateTwoPatterns(alter, 1, 2, index, bit_mask);
       break;
     case 0b1010:
-      AlternateTwoPatterns(first_alter, second_alter, 1, 3, index, bit_mask);
+      AlternateTwoPatterns(alter, 1, 3, index, bit_mask);
       break;
     case 0b1100:
-      AlternateTwoPatterns(first_alter, second_alter, 2, 3, index, bit_mask);
+      AlternateTwoPatterns(alter, 2, 3, index, bit_mask);
       break;
     case 0b0111:
-      AlternateOnePattern(first_alter, second_alter, 0, index, bit_mask);
+      AlternateOnePattern(alter, 0, index, bit_mask);
       break;
     case 0b1011:
-      AlternateOnePattern(first_alter, second_alter, 1, index, bit_mask);
+      AlternateOnePattern(alter, 1, index, bit_mask);
       break;
     case 0b1101:
-      AlternateOnePattern(first_alter, second_alter, 2, index, bit_mask);
+      AlternateOnePattern(alter, 2, index, bit_mask);
       break;
     case 0b1110:
-      AlternateOnePattern(first_alter, second_alter, 3, index, bit_mask);
+      AlternateOnePattern(alter, 3, index, bit_mask);
       break;
   }
 }
 
-void HammerWithPattern(
-    uint64_t* first_row,
-    uint64_t* second_row,
-    uint64_t* target_row,
-    uint64_t first_data,
-    uint64_t second_data,
-    uint64_t target_data,
-    uint64_t number_of_reads,
-    uint64_t* results) {
+namespace {
+
+// Bit v of first_ones[i] (second_ones[i]) is set if ComputePinpointData()
+// writes ones to the first (second) aggressor in phase i for flip results v.
+struct PhaseTruthTable {
+  uint16_t first_ones[kAlternatingPhases];
+  uint16_t second_ones[kAlternatingPhases];
+};
+
+PhaseTruthTable BuildPhaseTruthTable() {
+  static AlternatingData scratch;
+  PhaseTruthTable table;
+  memset(&table, 0, sizeof(table));
+  for (uint8_t flip_results = 0; flip_results < 16; flip_results++) {
+    ComputePinpointData(&scratch, 0, ONE, flip_results);
+    for (uint8_t i=0; i<12; i++) {
+      table.first_ones[i] |= (scratch.first_alter[i][0] & 1) << flip_results;
+      table.second_ones[i] |= (scratch.second_alter[i][0] & 1) << flip_results;
+    }
+  }
+  return table;
+}
 
-  memset(first_row, first_data, 0x2000);
-  memset(second_row, second_data, 0x2000);
-  memset(target_row, target_data, 0x2000);
+const PhaseTruthTable& GetPhaseTruthTable() {
+  static const PhaseTruthTable table = BuildPhaseTruthTable();
+  return table;
+}
 
-  for (uint32_t index = 0; index < 1024; index+=8) {
+template <typename Geometry>
+uint32_t CountBitFlipsT(const uint64_t* results) {
+  uint32_t count = 0;
+  for (uint32_t index = 0; index < Geometry::kRowWords; index++) {
+    count += __builtin_popcountll(results[index]);
+  }
+  return count;
+}
+
+template <typename Geometry>
+bool FindFirstBitFlipT(const uint64_t* results, BitFlip* flip) {
+  for (uint32_t index = 0; index < Geometry::kRowWords; index++) {
+    if (results[index] != 0) {
+      flip->index = index;
+      flip->bit_offset = __builtin_ctzll(results[index]);
+      flip->bit_mask = 1UL << flip->bit_offset;
+      return true;
+    }
+  }
+  return false;
+}
+
+// Computes the same alternating pattern as calling ComputePinpointData() for
+// every bit, but for 64 bits at a time.
+template <typename Geometry>
+uint8_t ComputeAlternatingPatternT(
+    PatternScan* scan,
+    const BitFlip& target,
+    uint8_t default_pattern,
+    AlternatingData* alter) {
+  uint64_t (*results)[kMaxRowWords] = scan->results;
+
+  // Calculate victim agnostic pattern
+  for (uint8_t pattern=0; pattern<4; pattern++) {
+    for (uint32_t index=0; index<Geometry::kRowWords; index++) {
+      results[pattern][index] |= results[pattern+4][index];
+    }
+  }
+
+  // select[i][v] is all ones if flip results v put ones into the first
+  // (second) aggressor in phase i.
+  const PhaseTruthTable& table = GetPhaseTruthTable();
+  uint64_t first_select[kAlternatingPhases][16];
+  uint64_t second_select[kAlternatingPhases][16];
+  for (uint8_t i=0; i<12; i++) {
+    for (uint8_t flip_results=0; flip_results<16; flip_results++) {
+      first_select[i][flip_results] =
+          0 - (uint64_t)((table.first_ones[i] >> flip_results) & 1);
+      second_select[i][flip_results] =
+          0 - (uint64_t)((table.second_ones[i] >> flip_results) & 1);
+    }
+  }
+
+  // Calculate alternating patttern
+  for (uint32_t index=0; index<Geometry::kRowWords; index++) {
+    // cells[v] has the bits of this word whose flip results are v, where
+    // pattern p contributes bit 3-p of v.
+    uint64_t cells[16];
+    for (uint8_t flip_results=0; flip_results<16; flip_results++) {
+      uint64_t cell = ONE;
+      for (uint8_t pattern=0; pattern<4; pattern++) {
+        uint64_t flips = results[pattern][index];
+        cell &= ((flip_results >> (3-pattern)) & 1) ? flips : ~flips;
+      }
+      cells[flip_results] = cell;
+    }
+    for (uint8_t i=0; i<12; i++) {
+      uint64_t first = 0;
+      uint64_t second = 0;
+      for (uint8_t flip_results=0; flip_results<16; flip_results++) {
+        first |= cells[flip_results] & first_select[i][flip_results];
+        second |= cells[flip_results] & second_select[i][flip_results];
+      }
+      alter->first_alter[i][index] = first;
+      alter->second_alter[i][index] = second;
+    }
+  }
+
+  uint8_t sum = 0;
+  for (uint8_t pattern=0; pattern<4; pattern++) {
+    sum |= ((results[pattern][target.index] >> target.bit_offset) & 1)
+        << (3-pattern);
+  }
+  uint8_t target_pattern = ChooseTargetPattern(sum, default_pattern);
+
+  asm volatile("mfence ;\n\t":::"memory");
+  // Set effective data patter from the target bit offset
+  for (uint8_t i=0; i<12; i++) {
+    SetPhasePattern(alter, i, target_pattern, target.index, target.bit_mask);
+  }
+  return target_pattern;
+}
+
+// Flushes the rows, then hammers the aggressors.
+template <typename Geometry>
+void HammerRowsT(const RowTriple& rows, uint64_t number_of_reads) {
+  uint64_t* first_row = rows.first_row;
+  uint64_t* second_row = rows.second_row;
+  uint64_t* target_row = rows.target_row;
+
+  for (uint32_t index = 0; index < Geometry::kRowWords;
+      index += Geometry::kCacheLineWords) {
     asm volatile(
         "clflush (%0);\n\t"
         "clflush (%1);\n\t"
@@ -187,42 +328,80 @@ void HammerWithPattern(
         ::"r"(&first_row[index]),"r"(&second_row[index]),"r"(&target_row[index]):"memory");
   }
 
-  while (number_of_reads-- > 0) {
-    //sum += first_pointer[0];
-    //sum += second_pointer[0];
-    asm volatile(
-        "mov (%0), %%rdx\n\t"
-        "mov (%1), %%rdx\n\t"
-        "clflush (%0);\n\t"
-        "clflush (%1);\n\t"
-        : : "r" (first_row), "r" (second_row) : "memory", "rdx");
+  PacedReads(number_of_reads, [first_row, second_row](uint64_t reads) {
+    while (reads-- > 0) {
+      asm volatile(
+          "mov (%0), %%rdx\n\t"
+          "mov (%1), %%rdx\n\t"
+          "clflush (%0);\n\t"
+          "clflush (%1);\n\t"
+          : : "r" (first_row), "r" (second_row) : "memory", "rdx");
+    }
+  });
+}
+
+template <typename Geometry>
+void HammerWithPatternT(
+    const RowTriple& rows,
+    const DataPattern& pattern,
+    uint64_t number_of_reads,
+    uint64_t* results) {
+  for (uint32_t index = 0; index < Geometry::kRowWords; index++) {
+    rows.first_row[index] = pattern.first;
+    rows.second_row[index] = pattern.second;
+    rows.target_row[index] = pattern.target;
   }
 
-  for (uint32_t index = 0; index < 1024; ++index) {
-    results[index] = target_row[index] ^ target_data;
+  HammerRowsT<Geometry>(rows, number_of_reads);
+
+  for (uint32_t index = 0; index < Geometry::kRowWords; ++index) {
+    results[index] = rows.target_row[index] ^ pattern.target;
   }
 }
 
-void PinpointRowhammer(
-    uint64_t* first_row,
-    uint64_t* second_row,
-    uint64_t* target_row,
+template <typename Geometry>
+void HammerWithDataT(
+    const RowTriple& rows,
+    const RowData& data,
+    uint64_t number_of_reads,
+    uint64_t* results) {
+  for (uint32_t index = 0; index < Geometry::kRowWords; index++) {
+    rows.first_row[index] = data.first[index];
+    rows.second_row[index] = data.second[index];
+    rows.target_row[index] = data.target[index];
+  }
+
+  HammerRowsT<Geometry>(rows, number_of_reads);
+
+  for (uint32_t index = 0; index < Geometry::kRowWords; ++index) {
+    results[index] = rows.target_row[index] ^ data.target[index];
+  }
+}
+
+template <typename Geometry>
+void PinpointRowhammerT(
+    const RowTriple& rows,
     uint64_t target_data,
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
-    uint32_t number_of_reads,
+    const AlternatingData& alter,
+    uint64_t number_of_reads,
     uint64_t* results) {
+  uint64_t* first_row = rows.first_row;
+  uint64_t* second_row = rows.second_row;
+  uint64_t* target_row = rows.target_row;
 
-  memset(target_row, target_data, 0x2000);
+  for (uint32_t index = 0; index < Geometry::kRowWords; index++) {
+    target_row[index] = target_data;
+  }
 
-  for (uint32_t index = 0; index < 1024; index+=8) {
+  for (uint32_t index = 0; index < Geometry::kRowWords;
+      index += Geometry::kCacheLineWords) {
     asm volatile(
         "clflush (%0);\n\t"
         ::"r"(&target_row[index]):"memory");
   }
 
   for (uint32_t i=0; i<12; i++) {
-    for (uint32_t index=0; index<1024; index++) {
+    for (uint32_t index=0; index<Geometry::kRowWords; index++) {
       __asm__ __volatile__(
           "mov %0, %%rdx\n\t"
           "mov %%rdx, (%1)\n\t"
@@ -231,22 +410,65 @@ void PinpointRowhammer(
           "clflush (%1)\n\t"
           "clflush (%3)\n\t"
           :
-          :"r" (first_alter[i][index]), "r" (&first_row[index]), "r" (second_alter[i][index]), "r" (&second_row[index])
+          :"r" (alter.first_alter[i][index]), "r" (&first_row[index]), "r" (alter.second_alter[i][index]), "r" (&second_row[index])
           :"rdx", "memory");
     }
 
-    uint32_t reads_per_pattern = number_of_reads/12-1024;
-    while (reads_per_pattern-- > 0) {
-      asm volatile(
-          "mov (%0), %%rdx\n\t"
-          "mov (%1), %%rdx\n\t"
-          "clflush (%0);\n\t"
-          "clflush (%1);\n\t"
-          : : "r" (first_row), "r" (second_row) : "memory", "rdx");
-    }
+    // Writing the aggressors already accessed each of them row_words times.
+    uint64_t reads_per_pattern = number_of_reads/12 > Geometry::kRowWords ?
+        number_of_reads/12-Geometry::kRowWords : 0;
+    PacedReads(reads_per_pattern, [first_row, second_row](uint64_t reads) {
+      while (reads-- > 0) {
+        asm volatile(
+            "mov (%0), %%rdx\n\t"
+            "mov (%1), %%rdx\n\t"
+            "clflush (%0);\n\t"
+            "clflush (%1);\n\t"
+            : : "r" (first_row), "r" (second_row) : "memory", "rdx");
+      }
+    });
   }
 
-  for (uint32_t index = 0; index < 1024; ++index) {
+  for (uint32_t index = 0; index < Geometry::kRowWords; ++index) {
     results[index] = target_row[index] ^ target_data;
   }
 }
+
+template <typename Geometry>
+constexpr PinpointKernels MakeKernels() {
+  return PinpointKernels{
+      Geometry::kRowBytes,
+      Geometry::kCacheLineBytes,
+      Geometry::kRowWords,
+      &CountBitFlipsT<Geometry>,
+      &FindFirstBitFlipT<Geometry>,
+      &ComputeAlternatingPatternT<Geometry>,
+      &HammerWithPatternT<Geometry>,
+      &HammerWithDataT<Geometry>,
+      &PinpointRowhammerT<Geometry>};
+}
+
+static_assert(RowGeometry<0x4000>::kRowWords <= kMaxRowWords,
+    "kMaxRowWords is too small for the largest instantiated row");
+
+}  // namespace
+
+// Rows of 4 KiB (DDR5 subchannels), 8 KiB (DDR3/DDR4) and 16 KiB.
+const PinpointKernels kPinpointKernels[] = {
+  MakeKernels<RowGeometry<0x1000> >(),
+  MakeKernels<RowGeometry<0x2000> >(),
+  MakeKernels<RowGeometry<0x4000> >(),
+};
+
+const uint32_t kNumPinpointKernels =
+    sizeof(kPinpointKernels) / sizeof(kPinpointKernels[0]);
+
+const PinpointKernels* SelectKernels(const DramGeometry& geometry) {
+  for (uint32_t i = 0; i < kNumPinpointKernels; i++) {
+    if (kPinpointKernels[i].row_bytes == geometry.row_bytes &&
+        kPinpointKernels[i].cache_line_bytes == geometry.cache_line_bytes) {
+      return &kPinpointKernels[i];
+    }
+  }
+  return NULL;
+}
@@ -12,37 +12,115 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#ifndef PINPOINT_MODULE_H_
+#define PINPOINT_MODULE_H_
+
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include "pinpoint_geometry.h"
+
+// Number of data patterns scanned per target row.
+const uint32_t kNumDataPatterns = 8;
+
+// Number of phases of an alternating pattern.
+const uint32_t kAlternatingPhases = 12;
+
+// Data written to the aggressor rows and the target row.
+struct DataPattern {
+  uint64_t first;
+  uint64_t target;
+  uint64_t second;
+};
+
+extern const DataPattern kDataPatterns[kNumDataPatterns];
+
+// Row sized data for the aggressor rows and the target row.
+struct RowData {
+  const uint64_t* first;
+  const uint64_t* target;
+  const uint64_t* second;
+};
+
+// Two aggressor rows and the target row sandwiched between them.
+struct RowTriple {
+  uint64_t* first_row;
+  uint64_t* target_row;
+  uint64_t* second_row;
+};
+
+// Results of hammering a row triple with every data pattern.
+// results[p][index] holds the flipped bits of the target row for pattern p.
+// Only the first row_words words of each row are used.
+struct PatternScan {
+  uint64_t results[kNumDataPatterns][kMaxRowWords];
+};
+
+// Aggressor row data for each phase of Pinpoint Rowhammer.
+struct AlternatingData {
+  uint64_t first_alter[kAlternatingPhases][kMaxRowWords];
+  uint64_t second_alter[kAlternatingPhases][kMaxRowWords];
+};
 
-extern uint64_t first_data[8];
-extern uint64_t target_data[8];
-extern uint64_t second_data[8];
+// Position of a single bit in a row.
+struct BitFlip {
+  uint32_t index;
+  uint32_t bit_offset;
+  uint64_t bit_mask;
+};
 
 void ComputePinpointData(
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
+    AlternatingData* alter,
     uint32_t index,
     uint64_t bit_mask,
     uint8_t flip_results);
 
-void HammerWithPattern(
-    uint64_t* first_row,
-    uint64_t* second_row,
-    uint64_t* target_row,
-    uint64_t first_data,
-    uint64_t second_data,
-    uint64_t target_data,
-    uint64_t number_of_reads,
-    uint64_t* results);
-
-void PinpointRowhammer(
-    uint64_t* first_row,
-    uint64_t* second_row,
-    uint64_t* target_row,
-    uint64_t target_data,
-    uint64_t first_alter[][1024],
-    uint64_t second_alter[][1024],
-    uint32_t number_of_reads,
-    uint64_t* results);
+// Kernels instantiated for one row geometry.
+struct PinpointKernels {
+  uint32_t row_bytes;
+  uint32_t cache_line_bytes;
+  uint32_t row_words;
+
+  uint32_t (*count_bit_flips)(const uint64_t* results);
+
+  // Finds the first flipped bit of results. Returns false if there is none.
+  bool (*find_first_bit_flip)(const uint64_t* results, BitFlip* flip);
+
+  // Folds the victim agnostic patterns of scan, fills alter with the
+  // alternating pattern of every bit and sets the effective data pattern for
+  // the target bit. Returns the data pattern chosen for the target bit.
+  uint8_t (*compute_alternating_pattern)(
+      PatternScan* scan,
+      const BitFlip& target,
+      uint8_t default_pattern,
+      AlternatingData* alter);
+
+  void (*hammer_with_pattern)(
+      const RowTriple& rows,
+      const DataPattern& pattern,
+      uint64_t number_of_reads,
+      uint64_t* results);
+
+  // Like hammer_with_pattern, with arbitrary data in every word.
+  void (*hammer_with_data)(
+      const RowTriple& rows,
+      const RowData& data,
+      uint64_t number_of_reads,
+      uint64_t* results);
+
+  void (*pinpoint_rowhammer)(
+      const RowTriple& rows,
+      uint64_t target_data,
+      const AlternatingData& alter,
+      uint64_t number_of_reads,
+      uint64_t* results);
+};
+
+extern const PinpointKernels kPinpointKernels[];
+extern const uint32_t kNumPinpointKernels;
+
+// Returns the kernels for the row and cache line size of geometry, or NULL if
+// no instantiation matches.
+const PinpointKernels* SelectKernels(const DramGeometry& geometry);
+
+#endif  // PINPOINT_MODULE_H_
@@ -0,0 +1,303 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_pipeline.h"
+
+#include <assert.h>
+#include <pthread.h>
+#include <sched.h>
+
+namespace {
+
+void PrintRows(const ExperimentInfo& info) {
+  printf("[!] Hammering rows (%lx/%lx/%lx)\n",
+      info.page_frame_numbers[0], info.page_frame_numbers[1],
+      info.page_frame_numbers[2]);
+}
+
+// Hammer thread: accounts runs kernel runs that started at start_ns.
+void CountHammerRuns(PinpointPipeline* pipeline, uint64_t start_ns,
+    uint32_t runs) {
+  WorkerTelemetry* telemetry = pipeline->telemetry;
+  uint64_t now = TelemetryNow();
+  TelemetryAdd(&telemetry->hammer_ns, now - start_ns);
+  TelemetryAdd(&telemetry->hammer_runs, runs);
+  TelemetryAdd(&telemetry->hammer_reads, runs * pipeline->number_of_reads);
+  telemetry->heartbeat_ns.store(now, std::memory_order_relaxed);
+}
+
+// Analysis thread: accounts flips of one target row.
+void CountFlips(PinpointPipeline* pipeline, uint8_t bank, uint32_t pattern,
+    uint32_t count) {
+  WorkerTelemetry* telemetry = pipeline->telemetry;
+  TelemetryAdd(&telemetry->flips_per_bank[bank % kMaxTelemetryBanks], count);
+  if (pattern < kNumDataPatterns) {
+    TelemetryAdd(&telemetry->flips_per_pattern[pattern], count);
+  }
+}
+
+// Returns true if a follow-up was requested.
+bool AnalyzeDetection(PinpointPipeline* pipeline, VictimSnapshot* snapshot) {
+  const PinpointKernels& kernels = *pipeline->kernels;
+  const uint64_t* results = snapshot->scan.results[pipeline->default_pattern];
+
+  PrintRows(snapshot->info);
+  uint32_t count = kernels.count_bit_flips(results);
+  // Per bank only; the scan counts every pattern of flipping rows.
+  CountFlips(pipeline, snapshot->info.bank, kNumDataPatterns, count);
+  if (count == 0) {
+    return false;
+  }
+  printf ("[!] Double-sided Rowhammer: %d bit flips\n", count);
+
+  // Choose target bit offset.
+  // In this code, pick up the first bit flip for simplicity.
+  HammerRequest* request = pipeline->requests.BeginPush();
+  assert(request != NULL);
+  request->kind = kScanRequest;
+  request->info = snapshot->info;
+  kernels.find_first_bit_flip(results, &request->info.target);
+  request->info.target_data =
+      kDataPatterns[pipeline->default_pattern].target;
+  pipeline->requests.CommitPush();
+  return true;
+}
+
+// The target row flipped in double_sided_rowhammer; scan it right away.
+void AnalyzeDiscovery(PinpointPipeline* pipeline, VictimSnapshot* snapshot) {
+  const BitFlip& target = snapshot->info.target;
+  PrintRows(snapshot->info);
+  printf("[!] Double-sided Rowhammer: flipped word %u bit %u from %d\n",
+      target.index, target.bit_offset,
+      static_cast<int>((snapshot->info.target_data >> target.bit_offset) & 1));
+
+  HammerRequest* request = pipeline->requests.BeginPush();
+  assert(request != NULL);
+  request->kind = kScanRequest;
+  request->info = snapshot->info;
+  pipeline->requests.CommitPush();
+}
+
+void AnalyzeScan(PinpointPipeline* pipeline, VictimSnapshot* snapshot) {
+  // Per pattern flip rates; the bank was counted at detection.
+  for (uint8_t pattern=0; pattern<kNumDataPatterns; pattern++) {
+    TelemetryAdd(&pipeline->telemetry->flips_per_pattern[pattern],
+        pipeline->kernels->count_bit_flips(snapshot->scan.results[pattern]));
+  }
+
+  HammerRequest* request = pipeline->requests.BeginPush();
+  assert(request != NULL);
+  request->kind = kPinpointRequest;
+  request->info = snapshot->info;
+  pipeline->kernels->compute_alternating_pattern(&snapshot->scan,
+      snapshot->info.target, pipeline->default_pattern, &request->alter);
+  pipeline->requests.CommitPush();
+}
+
+void AnalyzePinpoint(PinpointPipeline* pipeline, VictimSnapshot* snapshot) {
+  const uint64_t* ppt_results = snapshot->scan.results[0];
+  const BitFlip& target = snapshot->info.target;
+  uint32_t count = pipeline->kernels->count_bit_flips(ppt_results);
+  pipeline->total_bitflips += count;
+
+  if ((ppt_results[target.index]>>target.bit_offset)&1)
+    printf ("[!] Pinpoint Rowhammer: %d bit flips\n\n", count);
+  else
+    printf ("[!] Pinpoint Rowhammer: %d bit flips (no target bit flip)\n\n", count);
+}
+
+void AnalyzeCharacterization(PinpointPipeline* pipeline,
+    VictimSnapshot* snapshot) {
+  RowSignatures row;
+  for (uint32_t i = 0; i < 3; i++) {
+    row.page_frame_numbers[i] = snapshot->info.page_frame_numbers[i];
+  }
+  row.bank = snapshot->info.bank;
+  EncodeRowSignatures(snapshot->characterization,
+      pipeline->characterization_patterns->size(),
+      pipeline->kernels->row_words, &row);
+
+  PrintRows(snapshot->info);
+  if (row.num_cells > 0) {
+    printf("[!] Characterization: %u vulnerable cells\n", row.num_cells);
+  }
+  pipeline->total_bitflips += row.num_cells;
+  CountFlips(pipeline, row.bank, kNumDataPatterns, row.num_cells);
+
+  bool written = WriteRowSignatures(pipeline->profile_file, row);
+  assert(written);
+  pipeline->profile->rows.push_back(row);
+}
+
+}  // namespace
+
+PinpointPipeline* CreatePinpointPipeline(
+    const PinpointKernels* kernels,
+    uint8_t default_pattern,
+    uint64_t number_of_reads) {
+  PinpointPipeline* pipeline = new PinpointPipeline();
+  pipeline->kernels = kernels;
+  pipeline->default_pattern = default_pattern;
+  pipeline->number_of_reads = number_of_reads;
+  pipeline->characterization_patterns = NULL;
+  pipeline->profile_file = NULL;
+  pipeline->profile = NULL;
+  pipeline->finished.store(false);
+  pipeline->total_bitflips = 0;
+  pipeline->telemetry = DiscardedTelemetry();
+  return pipeline;
+}
+
+bool PinCurrentThread(int cpu) {
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(cpu, &cpus);
+  return pthread_setaffinity_np(pthread_self(), sizeof(cpus), &cpus) == 0;
+}
+
+void RunAnalysis(PinpointPipeline* pipeline) {
+  bool done = false;
+  uint32_t outstanding = 0;
+
+  while (!done || outstanding > 0) {
+    VictimSnapshot* snapshot = pipeline->snapshots.Front();
+    // Keep a request slot free for the follow-up of this snapshot. Yield
+    // while idle in case the analysis thread shares a core with hammering.
+    if (snapshot == NULL || pipeline->requests.Full()) {
+      sched_yield();
+      continue;
+    }
+
+    uint64_t start_ns = TelemetryNow();
+    switch (snapshot->kind) {
+      case kDetectSnapshot:
+        outstanding += AnalyzeDetection(pipeline, snapshot);
+        break;
+      case kDiscoverySnapshot:
+        AnalyzeDiscovery(pipeline, snapshot);
+        outstanding++;
+        break;
+      case kScanSnapshot:
+        AnalyzeScan(pipeline, snapshot);
+        break;
+      case kPinpointSnapshot:
+        AnalyzePinpoint(pipeline, snapshot);
+        outstanding--;
+        break;
+      case kCharacterizeSnapshot:
+        AnalyzeCharacterization(pipeline, snapshot);
+        break;
+      case kDoneSnapshot:
+        done = true;
+        break;
+    }
+    TelemetryAdd(&pipeline->telemetry->verify_ns, TelemetryNow() - start_ns);
+    pipeline->snapshots.Pop();
+  }
+  pipeline->finished.store(true, std::memory_order_release);
+}
+
+VictimSnapshot* AcquireSnapshot(PinpointPipeline* pipeline) {
+  VictimSnapshot* snapshot;
+  while ((snapshot = pipeline->snapshots.BeginPush()) == NULL) {
+    CpuRelax();
+  }
+  return snapshot;
+}
+
+void ServeHammerRequests(PinpointPipeline* pipeline) {
+  const PinpointKernels& kernels = *pipeline->kernels;
+  HammerRequest* request = &pipeline->current_request;
+  HammerRequest* pending;
+
+  while ((pending = pipeline->requests.Front()) != NULL) {
+    request->kind = pending->kind;
+    request->info = pending->info;
+    if (pending->kind == kPinpointRequest) {
+      request->alter = pending->alter;
+    }
+    pipeline->requests.Pop();
+
+    const RowTriple& rows = request->info.rows;
+    VictimSnapshot* snapshot = AcquireSnapshot(pipeline);
+    snapshot->info = request->info;
+    uint64_t start_ns = TelemetryNow();
+    if (request->kind == kScanRequest) {
+      // Scan with eight data patterns
+      for (uint8_t pattern=0; pattern<kNumDataPatterns; pattern++) {
+        kernels.hammer_with_pattern(rows, kDataPatterns[pattern],
+            pipeline->number_of_reads, snapshot->scan.results[pattern]);
+      }
+      snapshot->kind = kScanSnapshot;
+      CountHammerRuns(pipeline, start_ns, kNumDataPatterns);
+    } else {
+      // Perform Pinpoint Rowhammer
+      kernels.pinpoint_rowhammer(rows,
+          request->info.target_data, request->alter,
+          pipeline->number_of_reads, snapshot->scan.results[0]);
+      snapshot->kind = kPinpointSnapshot;
+      CountHammerRuns(pipeline, start_ns, 1);
+    }
+    pipeline->snapshots.CommitPush();
+  }
+}
+
+void SubmitTriple(PinpointPipeline* pipeline, const ExperimentInfo& info) {
+  const PinpointKernels& kernels = *pipeline->kernels;
+  // Follow-ups go first. Draining the request ring before every new triple
+  // also keeps it from filling up while the snapshot ring is full.
+  ServeHammerRequests(pipeline);
+
+  VictimSnapshot* snapshot = AcquireSnapshot(pipeline);
+  snapshot->info = info;
+  uint64_t start_ns = TelemetryNow();
+  if (pipeline->profile_file != NULL) {
+    RunCharacterization(kernels, info.rows,
+        *pipeline->characterization_patterns, pipeline->number_of_reads,
+        &snapshot->characterization);
+    snapshot->kind = kCharacterizeSnapshot;
+    CountHammerRuns(pipeline, start_ns,
+        pipeline->characterization_patterns->size());
+  } else {
+    kernels.hammer_with_pattern(info.rows,
+        kDataPatterns[pipeline->default_pattern], pipeline->number_of_reads,
+        snapshot->scan.results[pipeline->default_pattern]);
+    snapshot->kind = kDetectSnapshot;
+    CountHammerRuns(pipeline, start_ns, 1);
+  }
+  pipeline->snapshots.CommitPush();
+  TelemetryAdd(&pipeline->telemetry->triples_done, 1);
+}
+
+void SubmitDiscoveredTriple(PinpointPipeline* pipeline,
+    const ExperimentInfo& info) {
+  ServeHammerRequests(pipeline);
+
+  VictimSnapshot* snapshot = AcquireSnapshot(pipeline);
+  snapshot->info = info;
+  snapshot->kind = kDiscoverySnapshot;
+  pipeline->snapshots.CommitPush();
+  TelemetryAdd(&pipeline->telemetry->triples_done, 1);
+}
+
+void FinishPipeline(PinpointPipeline* pipeline) {
+  VictimSnapshot* snapshot = AcquireSnapshot(pipeline);
+  snapshot->kind = kDoneSnapshot;
+  pipeline->snapshots.CommitPush();
+
+  while (!pipeline->finished.load(std::memory_order_acquire)) {
+    ServeHammerRequests(pipeline);
+    CpuRelax();
+  }
+}
@@ -0,0 +1,160 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Producer/consumer split between hammering and result analysis.
+//
+// The hammer thread only hammers: it writes the XOR diffs of every
+// experiment straight into a VictimSnapshot slot of a lock-free ring. The
+// analysis thread, pinned to another core, counts flips, derives the
+// alternating pattern, logs and aggregates results, and sends follow-up
+// experiments (the eight pattern scan and Pinpoint Rowhammer) back through a
+// second ring. The hammer thread runs those between new triples, so it never
+// waits for analysis.
+//
+// In two-stage mode the flips double_sided_rowhammer logged (see
+// pinpoint_discovery.h) replace the default pattern detection: only triples
+// whose target row flipped there are queued, with that flip as the target,
+// and go straight to the pattern scan and Pinpoint Rowhammer.
+//
+// Deadlock freedom: the analysis thread only pops a snapshot once the
+// request ring has room for its follow-up, and the hammer thread copies a
+// request out of the ring before waiting for a snapshot slot.
+
+#ifndef PINPOINT_PIPELINE_H_
+#define PINPOINT_PIPELINE_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <stdio.h>
+#include "pinpoint_characterize.h"
+#include "pinpoint_module.h"
+#include "pinpoint_ring.h"
+#include "pinpoint_telemetry.h"
+
+enum SnapshotKind {
+  // Target row after hammering with the default pattern.
+  kDetectSnapshot,
+  // Target row that flipped in double_sided_rowhammer; nothing was
+  // hammered.
+  kDiscoverySnapshot,
+  // Target row after each of the eight data patterns.
+  kScanSnapshot,
+  // Target row after Pinpoint Rowhammer.
+  kPinpointSnapshot,
+  // Target row after each characterization pattern.
+  kCharacterizeSnapshot,
+  // The hammer thread has no more triples.
+  kDoneSnapshot,
+};
+
+// Where and how a snapshot was taken.
+struct ExperimentInfo {
+  RowTriple rows;
+  // first, target, second
+  uint64_t page_frame_numbers[3];
+  uint8_t bank;
+  // The target bit and the data Pinpoint Rowhammer writes to the target
+  // row, for kDiscoverySnapshot, kScanSnapshot and kPinpointSnapshot.
+  BitFlip target;
+  uint64_t target_data;
+};
+
+struct VictimSnapshot {
+  SnapshotKind kind;
+  ExperimentInfo info;
+  // XOR of the target row with the data written to it.
+  union {
+    PatternScan scan;
+    CharacterizationScan characterization;
+  };
+};
+
+enum RequestKind {
+  kScanRequest,
+  kPinpointRequest,
+};
+
+// A follow-up experiment asked for by the analysis thread.
+struct HammerRequest {
+  RequestKind kind;
+  ExperimentInfo info;
+  // Aggressor data for kPinpointRequest.
+  AlternatingData alter;
+};
+
+const uint32_t kSnapshotRingSize = 8;
+const uint32_t kRequestRingSize = 4;
+
+struct PinpointPipeline {
+  const PinpointKernels* kernels;
+  uint8_t default_pattern;
+  uint64_t number_of_reads;
+
+  // Characterization mode: the patterns swept by the hammer thread, and the
+  // profile the analysis thread appends to. profile_file is NULL otherwise.
+  const std::vector<CharacterizationPattern>* characterization_patterns;
+  FILE* profile_file;
+  CharacterizationProfile* profile;
+
+  SpscRing<VictimSnapshot, kSnapshotRingSize> snapshots;
+  SpscRing<HammerRequest, kRequestRingSize> requests;
+
+  // Set by the analysis thread once it has seen kDoneSnapshot and every
+  // follow-up it requested has come back.
+  std::atomic<bool> finished;
+  // Written by the analysis thread only.
+  uint64_t total_bitflips;
+
+  // The follow-up the hammer thread is running, copied out of the ring.
+  HammerRequest current_request;
+
+  // Progress counters; DiscardedTelemetry() unless the driver sets a slot.
+  WorkerTelemetry* telemetry;
+};
+
+// Allocates a pipeline; the rings are too large for the stack.
+PinpointPipeline* CreatePinpointPipeline(
+    const PinpointKernels* kernels,
+    uint8_t default_pattern,
+    uint64_t number_of_reads);
+
+// Pins the calling thread to cpu. Returns false if that is not possible.
+bool PinCurrentThread(int cpu);
+
+// Body of the analysis thread. Returns after kDoneSnapshot once all
+// follow-ups are analyzed.
+void RunAnalysis(PinpointPipeline* pipeline);
+
+// Hammer thread: waits for a free snapshot slot.
+VictimSnapshot* AcquireSnapshot(PinpointPipeline* pipeline);
+
+// Hammer thread: runs every pending follow-up experiment.
+void ServeHammerRequests(PinpointPipeline* pipeline);
+
+// Hammer thread: runs pending follow-ups, then hammers info.rows with the
+// default pattern (or every characterization pattern) and hands the result
+// to the analysis thread.
+void SubmitTriple(PinpointPipeline* pipeline, const ExperimentInfo& info);
+
+// Hammer thread: runs pending follow-ups, then queues info, whose target
+// and target_data come from a discovery log, for the pattern scan without
+// hammering it.
+void SubmitDiscoveredTriple(PinpointPipeline* pipeline,
+    const ExperimentInfo& info);
+
+// Hammer thread: signals the end of the triples and serves follow-ups until
+// the analysis thread has finished.
+void FinishPipeline(PinpointPipeline* pipeline);
+
+#endif  // PINPOINT_PIPELINE_H_
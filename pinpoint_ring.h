@@ -0,0 +1,80 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Single-producer/single-consumer lock-free ring.
+//
+// Slots are filled and drained in place, so large snapshots are never
+// copied: the producer writes into BeginPush() and publishes it with
+// CommitPush(), the consumer reads Front() and releases it with Pop().
+
+#ifndef PINPOINT_RING_H_
+#define PINPOINT_RING_H_
+
+#include <atomic>
+#include <stdint.h>
+
+template <typename T, uint32_t Capacity>
+class SpscRing {
+ public:
+  SpscRing() : head_(0), tail_(0) {}
+
+  // Producer side. Returns NULL if the ring is full.
+  T* BeginPush() {
+    uint64_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) == Capacity) {
+      return NULL;
+    }
+    return &slots_[head % Capacity];
+  }
+
+  void CommitPush() {
+    head_.store(head_.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+  }
+
+  bool Full() const {
+    return head_.load(std::memory_order_relaxed) -
+        tail_.load(std::memory_order_acquire) == Capacity;
+  }
+
+  // Consumer side. Returns NULL if the ring is empty.
+  T* Front() {
+    uint64_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return NULL;
+    }
+    return &slots_[tail % Capacity];
+  }
+
+  void Pop() {
+    tail_.store(tail_.load(std::memory_order_relaxed) + 1,
+        std::memory_order_release);
+  }
+
+ private:
+  // head_ and tail_ are written by different threads; keep them on
+  // different cache lines.
+  std::atomic<uint64_t> head_;
+  char head_padding_[64 - sizeof(std::atomic<uint64_t>)];
+  std::atomic<uint64_t> tail_;
+  char tail_padding_[64 - sizeof(std::atomic<uint64_t>)];
+  T slots_[Capacity];
+};
+
+// Busy-wait hint for spin loops on the rings.
+inline void CpuRelax() {
+  asm volatile("pause" ::: "memory");
+}
+
+#endif  // PINPOINT_RING_H_
@@ -16,7 +16,45 @@
 // Modified double_sided_rowhammer.cc for Pinpoint Rowhammer.i
 //
 // Compilation instructions:
-//   g++ -std=c++11 [filename]
+//   ./make.sh pinpoint_rowhammer
+//
+// ./pinpoint_rowhammer [-t nsecs] [-p percentage] [-g geometry]
+//                      [-A activations] [-W windows]
+//
+// Hammers every reachable row (for at most nsecs seconds with -t), acquires
+// the described fraction of memory (0.0 to 0.9 or so) and assumes the row
+// geometry of the named preset ("ddr3" by default). Every experiment
+// activates each aggressor the given number of times per 64 ms refresh
+// window (as often as possible by default) for the given number of windows
+// (2 by default), see pinpoint_calibrate.h.
+//
+// ./pinpoint_rowhammer -c profile [-P patterns] [-S seed] ...
+//
+// Characterizes every target row with the pattern set described in
+// pinpoint_characterize.h instead of running Pinpoint Rowhammer, and writes
+// the per-cell pattern signatures to profile.
+//
+// ./pinpoint_rowhammer -R profile
+//
+// Summarizes a profile written by -c.
+//
+// ./pinpoint_rowhammer -l map ...
+//
+// Learns which rows actually disturb each target row (see
+// pinpoint_adjacency.h) and writes them to map. Later runs given -a map
+// build their row triples from it.
+//
+// ./pinpoint_rowhammer -d flips ...
+//
+// Two-stage mode (see pinpoint_discovery.h): runs the pattern scan and
+// Pinpoint Rowhammer only on the triples that flipped in a
+// double_sided_rowhammer -o flips run, starting from a logged flip, and
+// skips detection. Use the geometry and adjacency map of that run.
+//
+// ./pinpoint_rowhammer -w workers ...
+//
+// Coordinator mode (see pinpoint_shard.h): forks workers that each map
+// percentage / workers of the memory and hammer the triples handed to them.
 //
 // Original author: Thomas Dullien (thomasdullien@google.com)
 // Modified author: Sangwoo Ji (sangwooji@postech.edu)
@@ -28,305 +66,476 @@
 #include <inttypes.h>
 #include <linux/kernel-page-flags.h>
 #include <map>
+#include <signal.h>
 #include <stdlib.h>
 #include <string>
 #include <sys/ioctl.h>
 #include <sys/mount.h>
+#include <sys/prctl.h>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/sysinfo.h>
 #include <sys/wait.h>
+#include <thread>
 #include <time.h>
 #include <unistd.h>
 #include <vector>
+#include "pinpoint_adjacency.h"
+#include "pinpoint_calibrate.h"
+#include "pinpoint_characterize.h"
+#include "pinpoint_discovery.h"
+#include "pinpoint_memory.h"
 #include "pinpoint_module.h"
+#include "pinpoint_pipeline.h"
+#include "pinpoint_shard.h"
+#include "pinpoint_telemetry.h"
 
 namespace {
 
 // The fraction of physical memory that should be mapped for testing.
 double fraction_of_physical_memory = 0.3;
 
-// The time to hammer before aborting. Defaults to one hour.
-uint64_t number_of_seconds_to_hammer = 3600;
+// The time to hammer before aborting. 0, the default, runs until every
+// reachable row is done.
+uint64_t number_of_seconds_to_hammer = 0;
 
-// The number of memory reads to try.
+// The number of memory reads to try, set from budget once the hammer loop
+// is calibrated.
 uint64_t number_of_reads = 1200000;
 
-// Obtain the size of the physical memory of the system.
-uint64_t GetPhysicalMemorySize() {
-  struct sysinfo info;
-  sysinfo( &info );
-  return (size_t)info.totalram * (size_t)info.mem_unit;
-}
-
-uint64_t GetPageFrameNumber(int pagemap, uint8_t* virtual_address) {
-  // Read the entry in the pagemap.
-  uint64_t value;
-  int got = pread(pagemap, &value, 8,
-                  (reinterpret_cast<uintptr_t>(virtual_address) / 0x1000) * 8);
-  assert(got == 8);
-  uint64_t page_frame_number = value & ((1ULL << 54)-1);
-  return page_frame_number;
+// Activations per refresh window (-A, 0 for as fast as possible) and
+// refresh windows (-W) of every experiment.
+HammerBudget budget = {0, 2};
+
+// The row, bank and page geometry of the tested module.
+const DramGeometry* geometry = &kGeometryPresets[0];
+
+// The data pattern used to detect flipping target rows.
+const uint8_t default_pattern = 2;
+
+// Characterization mode: the pattern set and seed swept over every target
+// row, and the profile the per-cell signatures are written to.
+const char* characterization_spec =
+    "pinpoint,rowstripe,colstripe,checkerboard,random:4";
+uint64_t characterization_seed = 0x5eed;
+const char* profile_path = NULL;
+FILE* profile_file = NULL;
+CharacterizationProfile profile;
+std::vector<CharacterizationPattern> characterization_patterns;
+
+// Adjacency: the map learned with -l, or read with -a to build triples.
+const char* adjacency_path = NULL;
+bool learn_adjacency = false;
+AdjacencyMap adjacency;
+
+// Set when the time is up. The hammer thread stops at the next triple, so
+// the analysis thread can finish the rows it has and close the profile.
+volatile sig_atomic_t stop_hammering = 0;
+
+// Two-stage mode: the flip log of double_sided_rowhammer, read with -d.
+const char* discovery_path = NULL;
+DiscoveryLog discovery;
+
+// Coordinator mode: the number of worker processes, each mapping its share
+// of fraction_of_physical_memory. 0 runs a single process.
+uint32_t num_shards = 0;
+ShardTotals shard_totals;
+
+// Progress counters for pinpoint_top, one slot per process.
+char telemetry_name[64];
+TelemetrySegment* telemetry = NULL;
+
+// The counters of worker, claimed by the calling process.
+WorkerTelemetry* TelemetrySlot(uint32_t worker) {
+  if (telemetry == NULL || worker >= telemetry->num_workers) {
+    return DiscardedTelemetry();
+  }
+  WorkerTelemetry* slot = &telemetry->workers[worker];
+  slot->pid.store(getpid(), std::memory_order_relaxed);
+  slot->heartbeat_ns.store(TelemetryNow(), std::memory_order_relaxed);
+  return slot;
 }
 
-void SetupMapping(uint64_t* mapping_size, void** mapping) {
-  *mapping_size = 
-    static_cast<uint64_t>((static_cast<double>(GetPhysicalMemorySize()) * 
-          fraction_of_physical_memory));
-
-  *mapping = mmap(NULL, *mapping_size, PROT_READ | PROT_WRITE,
-      MAP_POPULATE | MAP_ANONYMOUS | MAP_PRIVATE, -1, 0);
-  assert(*mapping != (void*)-1);
-
-  // Initialize the mapping so that the pages are non-empty.
-  printf("[!] Initializing large memory mapping ...");
-  for (uint64_t index = 0; index < *mapping_size; index += 0x1000) {
-    uint64_t* temporary = reinterpret_cast<uint64_t*>(
-        static_cast<uint8_t*>(*mapping) + index);
-    temporary[0] = index;
+// Runs the analysis thread of pipeline on analysis_cpu and pins the calling
+// (hammer) thread to hammer_cpu, unless both would share a CPU.
+std::thread StartAnalysis(PinpointPipeline* pipeline, int hammer_cpu,
+    int analysis_cpu) {
+  bool pin = hammer_cpu != analysis_cpu;
+  std::thread analysis([pipeline, pin, analysis_cpu]() {
+    if (pin) {
+      PinCurrentThread(analysis_cpu);
+    }
+    RunAnalysis(pipeline);
+  });
+  if (pin) {
+    PinCurrentThread(hammer_cpu);
   }
+  return analysis;
 }
 
-uint8_t GetPresumedBankNumber(
-    int pagemap,
-    uint8_t* address) {
-    uint64_t pfn  = GetPageFrameNumber(pagemap, address);
-    uint64_t pa = pfn << 12;
-    uint8_t presumed_bank_num = ((pa>>13)&7) ^((pa>>16)&7);
-
-    return presumed_bank_num;
+// Times the hammer loop on rows and sets number_of_reads to the budget.
+uint64_t CalibrateHammering(const PinpointKernels& kernels,
+    const RowTriple& rows) {
+  static uint64_t results[kMaxRowWords];
+  number_of_reads = CalibrateBudget("hammer_with_pattern",
+      [&kernels, &rows](uint64_t reads) {
+        kernels.hammer_with_pattern(rows, kDataPatterns[default_pattern],
+            reads, results);
+      }, budget);
+  return number_of_reads;
 }
 
-uint64_t HammerAddressesStandard(
-    const std::pair<uint64_t, uint64_t>& first_range,
-    const std::pair<uint64_t, uint64_t>& second_range,
-    uint64_t number_of_reads) {
-  volatile uint64_t* first_pointer =
-      reinterpret_cast<uint64_t*>(first_range.first);
-  volatile uint64_t* second_pointer =
-      reinterpret_cast<uint64_t*>(second_range.first);
-  uint64_t sum = 0;
-
-  while (number_of_reads-- > 0) {
-    //sum += first_pointer[0];
-    //sum += second_pointer[0];
-    asm volatile(
-        "mov (%0), %%rdx\n\t"
-        "mov (%1), %%rdx\n\t"
-        "clflush (%0);\n\t"
-        "clflush (%1);\n\t"
-        : : "r" (first_pointer), "r" (second_pointer) : "memory", "rdx");
-  }
-  return sum;
+// Builds the experiment of target_row in bank. In two-stage mode, triples
+// that did not flip in double_sided_rowhammer are skipped and the target
+// bit is the logged flip.
+bool BuildExperiment(const RowIndex& pages_per_row, const AdjacencyMap* map,
+    uint64_t target_row, uint8_t bank, ExperimentInfo* info) {
+  if (!BuildRowTriple(pages_per_row, *geometry, map, target_row, bank,
+        &info->rows, info->page_frame_numbers)) {
+    return false;
+  }
+  info->bank = bank;
+  if (discovery_path == NULL) {
+    return true;
+  }
+  info->target_data = DiscoveredTargetData(discovery);
+  return FindDiscoveredTarget(discovery, info->page_frame_numbers, bank,
+      geometry->row_bytes, &info->target);
 }
 
-typedef uint64_t(HammerFunction)(
-    const std::pair<uint64_t, uint64_t>& first_range,
-    const std::pair<uint64_t, uint64_t>& second_range,
-    uint64_t number_of_reads);
+// Hands info to the analysis thread, through detection unless the target
+// row flipped in double_sided_rowhammer.
+void SubmitExperiment(PinpointPipeline* pipeline, const ExperimentInfo& info) {
+  if (discovery_path != NULL) {
+    SubmitDiscoveredTriple(pipeline, info);
+  } else {
+    SubmitTriple(pipeline, info);
+  }
+}
 
 // A comprehensive test that attempts to hammer adjacent rows for a given 
 // assumed row size (and assumptions of sequential physical addresses for 
-// various rows.
-uint64_t HammerAllReachablePages(uint64_t presumed_row_size, 
+// various rows, unless an adjacency map says otherwise).
+//
+// Experiments are handed to the analysis thread through pipeline; this
+// thread only hammers.
+void HammerAllReachablePages(PinpointPipeline* pipeline,
     void* memory_mapping, uint64_t memory_mapping_size, HammerFunction* hammer,
     uint64_t number_of_reads) {
   // This vector will be filled with all the pages we can get access to for a
   // given row size.
-  std::vector<std::vector<uint8_t*>> pages_per_row;
-  uint64_t total_bitflips = 0;
-  uint8_t num_pages_per_row = presumed_row_size/(4*1024);
-  uint8_t default_pattern = 2;
-  uint64_t results[8][1024];
-  uint64_t ppt_results[1024];
-  uint64_t first_alter[12][1024];
-  uint64_t second_alter[12][1024];
-
-  pages_per_row.resize(memory_mapping_size / presumed_row_size);
+  RowIndex pages_per_row;
+  uint64_t presumed_row_size = PresumedRowSize(*geometry);
+  const AdjacencyMap* map = adjacency_path != NULL ? &adjacency : NULL;
+
   int pagemap = open("/proc/self/pagemap", O_RDONLY);
   assert(pagemap >= 0);
 
-  printf("[!] Identifying rows for accessible pages ... ");
-  for (uint64_t offset = 0; offset < memory_mapping_size; offset += 0x1000) {
-    uint8_t* virtual_address = static_cast<uint8_t*>(memory_mapping) + offset;
-    uint64_t page_frame_number = GetPageFrameNumber(pagemap, virtual_address);
-    uint64_t physical_address = page_frame_number * 0x1000;
-    uint64_t presumed_row_index = physical_address / presumed_row_size;
-    if (presumed_row_index > pages_per_row.size()) {
-      pages_per_row.resize(presumed_row_index);
+  uint64_t start_ns = TelemetryNow();
+  BuildRowIndex(pagemap, memory_mapping, memory_mapping_size,
+      presumed_row_size, &pages_per_row);
+
+  // Count the triples up front for the ETA, and calibrate on the first.
+  uint64_t planned_triples = 0;
+  RowTriple calibration_rows;
+  for (uint64_t target_row = 0; target_row < pages_per_row.size();
+      ++target_row) {
+    for (uint8_t bank = 0; bank < geometry->num_banks; bank++) {
+      ExperimentInfo info;
+      if (BuildExperiment(pages_per_row, map, target_row, bank, &info)) {
+        calibration_rows =
+            planned_triples == 0 ? info.rows : calibration_rows;
+        planned_triples++;
+      }
     }
-    pages_per_row[presumed_row_index].push_back(virtual_address);
   }
-  printf("Done\n");
+  if (telemetry != NULL) {
+    telemetry->planned_triples.store(planned_triples);
+  }
+  if (planned_triples > 0) {
+    pipeline->number_of_reads =
+        CalibrateHammering(*pipeline->kernels, calibration_rows);
+  }
+  TelemetryAdd(&pipeline->telemetry->setup_ns, TelemetryNow() - start_ns);
 
   // We should have some pages for most rows now.
-  for (uint64_t row_index = 0; row_index + 2 < pages_per_row.size(); 
-      ++row_index) {
-    if ((pages_per_row[row_index].size() != num_pages_per_row) || 
-        (pages_per_row[row_index+2].size() != num_pages_per_row)) {
-      continue;
-    } else if (pages_per_row[row_index+1].size() == 0) {
+  for (uint64_t target_row = 0;
+      target_row < pages_per_row.size() && !stop_hammering; ++target_row) {
+    if (pages_per_row[target_row].size() == 0) {
       continue;
     }
     
-    for (uint8_t target_bank=0; target_bank<8; target_bank++) {  
-      uint64_t* first_row;
-      uint64_t* second_row;
-      uint64_t* target_row;
-      for (uint8_t* first_row_page : pages_per_row[row_index]) {
-        if(GetPresumedBankNumber(pagemap, first_row_page)==target_bank) {
-          first_row=reinterpret_cast<uint64_t*>(first_row_page);
-          break;
-        }
-      }
-      for (uint8_t* second_row_page : pages_per_row[row_index+2]) {
-        if(GetPresumedBankNumber(pagemap, second_row_page)==target_bank) {
-          second_row=reinterpret_cast<uint64_t*>(second_row_page);
-          break;
-        }
-      }
-      for (uint8_t* target_row_page : pages_per_row[row_index+1]) {
-        if(GetPresumedBankNumber(pagemap, target_row_page)==target_bank) {
-          target_row=reinterpret_cast<uint64_t*>(target_row_page);
-          break;
-        }
+    for (uint8_t target_bank=0;
+        target_bank<geometry->num_banks && !stop_hammering; target_bank++) {
+      ExperimentInfo info;
+      if (!BuildExperiment(pages_per_row, map, target_row, target_bank,
+            &info)) {
+        continue;
       }
 
-      printf("[!] Hammering rows (%lx/%lx/%lx)\n", 
-          GetPageFrameNumber(pagemap, reinterpret_cast<uint8_t*>(first_row)),
-          GetPageFrameNumber(pagemap, reinterpret_cast<uint8_t*>(target_row)),
-          GetPageFrameNumber(pagemap, reinterpret_cast<uint8_t*>(second_row)));
-
-      HammerWithPattern(first_row, second_row, target_row,
-          first_data[default_pattern], second_data[default_pattern], target_data[default_pattern], 
-          number_of_reads, results[default_pattern]);
-
-
-      uint32_t target_index=-1, target_pattern, target_bit_offset;
-      uint64_t target_bit_mask;
-      uint32_t count=0;
-      for (uint32_t index=0; index<1024; index++) {
-        if (results[default_pattern][index] != 0) {
-          uint64_t temp = results[default_pattern][index];
-          for (uint32_t bit_offset=0; bit_offset<64; bit_offset++) {
-            count += (temp>>bit_offset)&1;
-
-            // Choose target bit offset.
-            // In this code, pick up the first bit flip for simplicity.
-            if (((temp>>bit_offset)&1) && target_index == -1) {
-              target_index = index;
-              target_bit_mask = 1UL<<bit_offset;
-              target_bit_offset = bit_offset;
-            }
-          }
-        }
-      }
+      SubmitExperiment(pipeline, info);
+    }
+  }
+}
 
-      if (count > 0) {
-        printf ("[!] Double-sided Rowhammer: %d bit flips\n", count);
-      } else {
-        continue;
-      }
+// Learns the aggressor rows of every reachable target row and writes the
+// adjacency map, stopping early when the time is up.
+void LearnAllReachableRows(const PinpointKernels& kernels,
+    void* memory_mapping, uint64_t memory_mapping_size) {
+  RowIndex pages_per_row;
+  int pagemap = open("/proc/self/pagemap", O_RDONLY);
+  assert(pagemap >= 0);
 
-      // Scan with eight data patterns
-      for (uint8_t pattern=0; pattern<8; pattern++) { 
-        HammerWithPattern(first_row, second_row, target_row,
-            first_data[pattern], second_data[pattern], target_data[pattern], 
-            number_of_reads, results[pattern]);
+  WorkerTelemetry* slot = TelemetrySlot(0);
+  uint64_t start_ns = TelemetryNow();
+  BuildRowIndex(pagemap, memory_mapping, memory_mapping_size,
+      PresumedRowSize(*geometry), &pages_per_row);
+  InitAdjacencyMap(*geometry, &adjacency);
+  TelemetryAdd(&slot->setup_ns, TelemetryNow() - start_ns);
+  if (telemetry != NULL) {
+    telemetry->planned_triples.store(pages_per_row.size() *
+        geometry->num_banks);
+  }
+  bool calibrated = false;
+  for (uint64_t target_row = 0;
+      target_row < pages_per_row.size() && !calibrated; ++target_row) {
+    for (uint8_t bank = 0; bank < geometry->num_banks && !calibrated;
+        bank++) {
+      RowTriple rows;
+      uint64_t page_frame_numbers[3];
+      if (BuildRowTriple(pages_per_row, *geometry, NULL, target_row, bank,
+            &rows, page_frame_numbers)) {
+        CalibrateHammering(kernels, rows);
+        calibrated = true;
       }
+    }
+  }
 
-      // Calculate victim agnostic pattern
-      for (uint8_t pattern=0; pattern<4; pattern++) {
-        for (uint32_t index=0; index<1024; index++) {
-          results[pattern][index] |= results[pattern+4][index];
-        }
+  for (uint64_t target_row = 0;
+      target_row < pages_per_row.size() && !stop_hammering; ++target_row) {
+    for (uint8_t bank = 0; bank < geometry->num_banks && !stop_hammering;
+        bank++) {
+      start_ns = TelemetryNow();
+      uint32_t count = LearnRowNeighbors(kernels, pages_per_row, *geometry,
+          target_row, bank, kDataPatterns[default_pattern], number_of_reads,
+          &adjacency);
+      TelemetryAdd(&slot->hammer_ns, TelemetryNow() - start_ns);
+      TelemetryAdd(&slot->triples_done, 1);
+      TelemetryAdd(&slot->flips_per_bank[bank % kMaxTelemetryBanks], count);
+      slot->heartbeat_ns.store(TelemetryNow(), std::memory_order_relaxed);
+      if (count > 0) {
+        const RowNeighbors& neighbors = adjacency.banks[bank][target_row];
+        printf("[!] Row %lu bank %d: %u bit flips with rows %+d/%+d\n",
+            target_row, bank, count, neighbors.first, neighbors.second);
       }
+    }
+  }
 
-      // Calculate alternating patttern
-      for (uint32_t index=0; index<1024; index++) {
-        for (uint32_t bit_offset=0; bit_offset<64; bit_offset++) {
-          uint64_t bit_mask = 1UL << bit_offset;
-          uint8_t sum=0;
-          for (uint8_t pattern=0; pattern<4; pattern++) {
-            sum += ((results[pattern][index]&bit_mask)>>bit_offset)<<(3-pattern);
-            // If target bit is vulnerable to multiple data pattern,
-            // choose one of them empirically.
-            if ((index==target_index) && (bit_offset==target_bit_offset))
-              switch (sum) {
-                case 0b0010:
-                case 0b0011:
-                case 0b0110:
-                case 0b0111:
-                case 0b1010:
-                case 0b1011:
-                case 0b1110:
-                case 0b1111:
-                  target_pattern=2;
-                  break;
-                case 0b1000:
-                case 0b1001:
-                case 0b1100:
-                case 0b1101:
-                  target_pattern=0;
-                  break;
-                case 0b0001:
-                case 0b0101:
-                 target_pattern=3;
-                   break;
-                case 0b0100:
-                  target_pattern=1;
-                  break;
-                case 0b0000:
-                  target_pattern=default_pattern;
-                  break;
-              }
-          }
-          ComputePinpointData(first_alter, second_alter, index, bit_mask, sum); 
-        }
-      }
+  if (!WriteAdjacencyMap(adjacency_path, adjacency)) {
+    fprintf(stderr, "[-] Can't write adjacency map %s\n", adjacency_path);
+    exit(EXIT_FAILURE);
+  }
+  PrintAdjacencySummary(adjacency);
+}
+
+// Body of a worker process in coordinator mode: maps its share of memory,
+// reports the triples it can build and hammers the batches it is handed.
+void RunShardWorker(uint32_t shard, uint32_t num_shards, int socket) {
+  // Do not outlive the coordinator.
+  prctl(PR_SET_PDEATHSIG, SIGKILL);
 
-      asm volatile("mfence ;\n\t":::"memory");
-      // Set effective data patter from the target bit offset 
-      for (uint8_t i=0; i<12; i++) {
-        first_alter[i][target_index] = (first_alter[i][target_index]&(~target_bit_mask))|(first_data[target_pattern]&target_bit_mask);
-        second_alter[i][target_index] = (second_alter[i][target_index]&(~target_bit_mask))|(second_data[target_pattern]&target_bit_mask);
+  uint64_t mapping_size;
+  void* mapping;
+  const PinpointKernels* kernels = SelectKernels(*geometry);
+  const AdjacencyMap* map = adjacency_path != NULL ? &adjacency : NULL;
+  WorkerTelemetry* slot = TelemetrySlot(shard);
+  uint64_t start_ns = TelemetryNow();
+  SetupMapping(fraction_of_physical_memory / num_shards, geometry->page_bytes,
+      &mapping_size, &mapping);
+
+  RowIndex pages_per_row;
+  int pagemap = open("/proc/self/pagemap", O_RDONLY);
+  assert(pagemap >= 0);
+  BuildRowIndex(pagemap, mapping, mapping_size, PresumedRowSize(*geometry),
+      &pages_per_row);
+  TelemetryAdd(&slot->setup_ns, TelemetryNow() - start_ns);
+
+  std::vector<uint64_t> keys;
+  RowTriple calibration_rows;
+  for (uint64_t target_row = 0; target_row < pages_per_row.size();
+      ++target_row) {
+    for (uint8_t bank = 0; bank < geometry->num_banks; bank++) {
+      ExperimentInfo info;
+      if (BuildExperiment(pages_per_row, map, target_row, bank, &info)) {
+        calibration_rows = keys.empty() ? info.rows : calibration_rows;
+        keys.push_back(TripleKey(target_row, bank));
       }
+    }
+  }
+  if (!keys.empty()) {
+    CalibrateHammering(*kernels, calibration_rows);
+  }
+  ShardMessage header = {kShardTriples, static_cast<uint32_t>(keys.size()),
+      0};
+  if (!SendShardMessage(socket, header, keys)) {
+    exit(EXIT_FAILURE);
+  }
 
-      // Perform Pinpoint Rowhammer
-      PinpointRowhammer(first_row, second_row, target_row, target_data[default_pattern], 
-          first_alter, second_alter, number_of_reads, ppt_results);
-
-      count=0;
-      for (uint32_t index=0; index<1024; index++) {
-        if (ppt_results[index] != 0) {
-          uint64_t temp = ppt_results[index];
-          for (uint32_t bit_offset=0; bit_offset<64; bit_offset++) {
-            count += (temp>>bit_offset)&1;
-          }
-        }
+  // Spread the workers over the CPUs, hammering from the low ones.
+  int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  int hammer_cpu = shard % num_cpus;
+  int analysis_cpu = num_cpus - 1 - hammer_cpu;
+  while (ReceiveShardMessage(socket, &header, &keys) &&
+      header.type == kShardWork) {
+    PinpointPipeline* pipeline =
+        CreatePinpointPipeline(kernels, default_pattern, number_of_reads);
+    pipeline->telemetry = slot;
+    std::thread analysis = StartAnalysis(pipeline, hammer_cpu, analysis_cpu);
+    for (uint64_t key : keys) {
+      ExperimentInfo info;
+      if (BuildExperiment(pages_per_row, map, TripleKeyRow(key),
+            TripleKeyBank(key), &info)) {
+        SubmitExperiment(pipeline, info);
       }
+    }
+    FinishPipeline(pipeline);
+    analysis.join();
 
-      if ((ppt_results[target_index]>>target_bit_offset)&1)
-        printf ("[!] Pinpoint Rowhammer: %d bit flips\n\n", count);
-      else
-        printf ("[!] Pinpoint Rowhammer: %d bit flips (no target bit flip)\n\n", count);
+    ShardMessage result = {kShardResult, 0, pipeline->total_bitflips};
+    delete pipeline;
+    if (!SendShardMessage(socket, result, std::vector<uint64_t>())) {
+      exit(EXIT_FAILURE);
     }
   }
-  return total_bitflips;
+}
+
+void PrintShardTotals() {
+  printf("[!] %lu triples hammered by %u shards (%u restarts), "
+      "%lu bit flips in total\n", shard_totals.triples, num_shards,
+      shard_totals.restarts, shard_totals.bitflips);
 }
 
 void HammerAllReachableRows(HammerFunction* hammer, uint64_t number_of_reads) {
   uint64_t mapping_size;
   void* mapping;
-  SetupMapping(&mapping_size, &mapping);
+  const PinpointKernels* kernels = SelectKernels(*geometry);
+  if (kernels == NULL) {
+    fprintf(stderr, "[-] No kernels for %u-byte rows\n", geometry->row_bytes);
+    exit(EXIT_FAILURE);
+  }
+  if (profile_path != NULL) {
+    if (!BuildCharacterizationPatterns(characterization_spec,
+          kernels->row_words, characterization_seed,
+          &characterization_patterns)) {
+      exit(EXIT_FAILURE);
+    }
+    profile.row_bytes = kernels->row_bytes;
+    profile.seed = characterization_seed;
+    for (const CharacterizationPattern& pattern : characterization_patterns) {
+      profile.pattern_names.push_back(pattern.name);
+    }
+    profile_file = fopen(profile_path, "wb");
+    if (profile_file == NULL || !WriteProfileHeader(profile_file, profile)) {
+      fprintf(stderr, "[-] Can't write profile %s\n", profile_path);
+      exit(EXIT_FAILURE);
+    }
+    printf("[!] Characterizing with %zu patterns into %s\n",
+        characterization_patterns.size(), profile_path);
+  }
+  if (adjacency_path != NULL && !learn_adjacency) {
+    if (!ReadAdjacencyMap(adjacency_path, &adjacency) ||
+        adjacency.presumed_row_size != PresumedRowSize(*geometry) ||
+        adjacency.num_banks != geometry->num_banks) {
+      fprintf(stderr, "[-] Can't use adjacency map %s with geometry %s\n",
+          adjacency_path, geometry->name);
+      exit(EXIT_FAILURE);
+    }
+    PrintAdjacencySummary(adjacency);
+  }
+  if (discovery_path != NULL) {
+    if (!ReadDiscoveryLog(discovery_path, &discovery)) {
+      fprintf(stderr, "[-] Can't read flip log %s\n", discovery_path);
+      exit(EXIT_FAILURE);
+    }
+    printf("[!] %zu flipped target pages in %s\n", discovery.victims.size(),
+        discovery_path);
+  }
+  snprintf(telemetry_name, sizeof(telemetry_name), "/pinpoint_rowhammer.%d",
+      getpid());
+  telemetry = CreateTelemetry(telemetry_name,
+      num_shards > 0 ? num_shards : 1, geometry->num_banks);
+  if (telemetry != NULL) {
+    printf("[!] Progress counters in /dev/shm%s, watch with pinpoint_top "
+        "%d\n", telemetry_name, getpid());
+  } else {
+    fprintf(stderr, "[-] Can't create /dev/shm%s, running without progress "
+        "counters\n", telemetry_name);
+  }
 
-  HammerAllReachablePages(1024*64, mapping, mapping_size,
+  if (num_shards > 0) {
+    RunCoordinator(num_shards, &RunShardWorker,
+        telemetry != NULL ? &telemetry->planned_triples : NULL,
+        &shard_totals);
+    PrintShardTotals();
+    UnlinkTelemetry(telemetry_name);
+    return;
+  }
+  WorkerTelemetry* slot = TelemetrySlot(0);
+  uint64_t start_ns = TelemetryNow();
+  SetupMapping(fraction_of_physical_memory, geometry->page_bytes,
+      &mapping_size, &mapping);
+  TelemetryAdd(&slot->setup_ns, TelemetryNow() - start_ns);
+
+  if (learn_adjacency) {
+    LearnAllReachableRows(*kernels, mapping, mapping_size);
+    UnlinkTelemetry(telemetry_name);
+    return;
+  }
+
+  PinpointPipeline* pipeline =
+      CreatePinpointPipeline(kernels, default_pattern, number_of_reads);
+  pipeline->telemetry = slot;
+  if (profile_file != NULL) {
+    pipeline->characterization_patterns = &characterization_patterns;
+    pipeline->profile_file = profile_file;
+    pipeline->profile = &profile;
+  }
+
+  // Keep analysis off the hammering core.
+  int num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  std::thread analysis = StartAnalysis(pipeline, 0, num_cpus - 1);
+
+  HammerAllReachablePages(pipeline, mapping, mapping_size,
                           hammer, number_of_reads);
+  FinishPipeline(pipeline);
+  analysis.join();
+
+  if (stop_hammering) {
+    printf("[!] Spent %ld seconds hammering, stopping now.\n",
+        number_of_seconds_to_hammer);
+  }
+  printf("[!] %lu bit flips in total\n", pipeline->total_bitflips);
+  if (profile_file != NULL) {
+    fclose(profile_file);
+    PrintProfileSummary(profile);
+  }
+  UnlinkTelemetry(telemetry_name);
 }
 
 void HammeredEnough(int sig) {
+  // A single process drains its pipeline, or writes the learned map, once
+  // it notices.
+  if (num_shards == 0) {
+    stop_hammering = 1;
+    return;
+  }
   printf("[!] Spent %ld seconds hammering, exiting now.\n",
       number_of_seconds_to_hammer);
+  StopShards();
+  PrintShardTotals();
+  if (telemetry != NULL) {
+    UnlinkTelemetry(telemetry_name);
+  }
   fflush(stdout);
   fflush(stderr);
   exit(0);
@@ -338,6 +547,90 @@ int main(int argc, char** argv) {
   // Turn off stdout buffering when it is a pipe.
   setvbuf(stdout, NULL, _IONBF, 0);
 
+  int opt;
+  while ((opt = getopt(argc, argv, "t:p:g:c:P:S:R:l:a:d:w:A:W:")) != -1) {
+    switch (opt) {
+      case 't':
+        number_of_seconds_to_hammer = atoi(optarg);
+        break;
+      case 'p':
+        fraction_of_physical_memory = atof(optarg);
+        break;
+      case 'g':
+        geometry = FindGeometry(optarg);
+        if (geometry == NULL) {
+          fprintf(stderr, "[-] Unknown geometry %s, choose one of:\n", optarg);
+          PrintGeometryPresets(stderr);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'c':
+        profile_path = optarg;
+        break;
+      case 'P':
+        characterization_spec = optarg;
+        break;
+      case 'S':
+        characterization_seed = strtoull(optarg, NULL, 0);
+        break;
+      case 'R':
+        if (!ReadProfile(optarg, &profile)) {
+          fprintf(stderr, "[-] Can't read profile %s\n", optarg);
+          exit(EXIT_FAILURE);
+        }
+        PrintProfileSummary(profile);
+        exit(EXIT_SUCCESS);
+      case 'l':
+        adjacency_path = optarg;
+        learn_adjacency = true;
+        break;
+      case 'a':
+        adjacency_path = optarg;
+        learn_adjacency = false;
+        break;
+      case 'd':
+        discovery_path = optarg;
+        break;
+      case 'w':
+        num_shards = strtoul(optarg, NULL, 0);
+        if (atoi(optarg) <= 0 || num_shards > kMaxTelemetryWorkers) {
+          fprintf(stderr, "[-] The number of workers must be between 1 and "
+              "%u\n", kMaxTelemetryWorkers);
+          exit(EXIT_FAILURE);
+        }
+        break;
+      case 'A':
+        budget.activations_per_window = strtoull(optarg, NULL, 0);
+        break;
+      case 'W':
+        budget.windows = atoi(optarg);
+        if (budget.windows == 0) {
+          fprintf(stderr, "[-] At least one refresh window is needed\n");
+          exit(EXIT_FAILURE);
+        }
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-t nsecs] [-p percent] [-g geometry] "
+            "[-c profile [-P patterns] [-S seed]] [-R profile] "
+            "[-l map | -a map] [-d flips] [-w workers] [-A activations] "
+            "[-W windows]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (num_shards > 0 && (profile_path != NULL || learn_adjacency)) {
+    fprintf(stderr, "[-] -w can't be combined with -c or -l\n");
+    exit(EXIT_FAILURE);
+  }
+  if (discovery_path != NULL && (profile_path != NULL || learn_adjacency)) {
+    fprintf(stderr, "[-] -d can't be combined with -c or -l\n");
+    exit(EXIT_FAILURE);
+  }
+
+  signal(SIGALRM, HammeredEnough);
+
   printf("[!] Starting the testing process...\n");
+  if (number_of_seconds_to_hammer > 0) {
+    alarm(number_of_seconds_to_hammer);
+  }
   HammerAllReachableRows(&HammerAddressesStandard, number_of_reads);
 }
@@ -0,0 +1,56 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Helpers shared by the on-disk formats (characterization profiles and
+// adjacency maps). Values are written in host byte order.
+
+#ifndef PINPOINT_SERIALIZE_H_
+#define PINPOINT_SERIALIZE_H_
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+inline void AppendVarint(uint32_t value, std::vector<uint8_t>* out) {
+  while (value >= 0x80) {
+    out->push_back((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  out->push_back(value);
+}
+
+inline bool ReadVarint(const std::vector<uint8_t>& in, size_t* offset,
+    uint32_t* value) {
+  *value = 0;
+  for (uint32_t shift = 0; shift < 32 && *offset < in.size(); shift += 7) {
+    uint8_t byte = in[(*offset)++];
+    *value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+    if ((byte & 0x80) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+template <typename T>
+bool WriteValue(FILE* file, const T& value) {
+  return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+template <typename T>
+bool ReadValue(FILE* file, T* value) {
+  return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+#endif  // PINPOINT_SERIALIZE_H_
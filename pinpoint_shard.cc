@@ -0,0 +1,265 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_shard.h"
+
+#include <assert.h>
+#include <deque>
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <unordered_set>
+
+namespace {
+
+struct Shard {
+  pid_t pid;
+  int socket;
+  uint32_t restarts;
+  bool stopped;
+  // Triples reported by the worker and not handed out yet.
+  std::deque<uint64_t> queue;
+  // The batch the worker is hammering.
+  std::vector<uint64_t> in_flight;
+};
+
+// Workers of the running coordinator, for StopShards().
+std::vector<Shard>* live_shards = NULL;
+
+bool WriteFully(int fd, const void* data, size_t size) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(data);
+  while (size > 0) {
+    ssize_t written = write(fd, bytes, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    }
+    if (written <= 0) {
+      return false;
+    }
+    bytes += written;
+    size -= written;
+  }
+  return true;
+}
+
+bool ReadFully(int fd, void* data, size_t size) {
+  uint8_t* bytes = static_cast<uint8_t*>(data);
+  while (size > 0) {
+    ssize_t got = read(fd, bytes, size);
+    if (got < 0 && errno == EINTR) {
+      continue;
+    }
+    if (got <= 0) {
+      return false;
+    }
+    bytes += got;
+    size -= got;
+  }
+  return true;
+}
+
+void StartShard(uint32_t index, uint32_t num_shards, ShardWorker* worker,
+    Shard* shard) {
+  int sockets[2];
+  int created = socketpair(AF_UNIX, SOCK_STREAM, 0, sockets);
+  assert(created == 0);
+
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    close(sockets[0]);
+    // Drop the sockets of the other workers so their EOF is not delayed.
+    for (const Shard& other : *live_shards) {
+      if (other.socket >= 0) {
+        close(other.socket);
+      }
+    }
+    worker(index, num_shards, sockets[1]);
+    _exit(EXIT_SUCCESS);
+  }
+  close(sockets[1]);
+  shard->pid = pid;
+  shard->socket = sockets[0];
+  shard->stopped = false;
+  shard->queue.clear();
+  shard->in_flight.clear();
+  printf("[!] Shard %u: started worker %d\n", index, pid);
+}
+
+// Answers a worker message with the next batch, or kShardStop.
+bool SendWork(Shard* shard) {
+  ShardMessage header = {kShardWork, 0, 0};
+  shard->in_flight.clear();
+  while (!shard->queue.empty() &&
+      shard->in_flight.size() < kShardBatchTriples) {
+    shard->in_flight.push_back(shard->queue.front());
+    shard->queue.pop_front();
+  }
+  if (shard->in_flight.empty()) {
+    header.type = kShardStop;
+    shard->stopped = true;
+  }
+  header.count = shard->in_flight.size();
+  return SendShardMessage(shard->socket, header, shard->in_flight);
+}
+
+}  // namespace
+
+bool SendShardMessage(int socket, const ShardMessage& header,
+    const std::vector<uint64_t>& keys) {
+  return WriteFully(socket, &header, sizeof(header)) &&
+      WriteFully(socket, keys.data(), header.count * sizeof(uint64_t));
+}
+
+bool ReceiveShardMessage(int socket, ShardMessage* header,
+    std::vector<uint64_t>* keys) {
+  if (!ReadFully(socket, header, sizeof(*header))) {
+    return false;
+  }
+  keys->resize(header->type == kShardTriples || header->type == kShardWork ?
+      header->count : 0);
+  return ReadFully(socket, keys->data(), keys->size() * sizeof(uint64_t));
+}
+
+void RunCoordinator(uint32_t num_shards, ShardWorker* worker,
+    std::atomic<uint64_t>* planned_triples, ShardTotals* totals) {
+  std::vector<Shard> shards(num_shards);
+  // Triples handed to, or waiting for, a live worker, and finished ones.
+  std::unordered_set<uint64_t> claimed;
+  std::vector<uint64_t> keys;
+  totals->triples = 0;
+  totals->bitflips = 0;
+  totals->restarts = 0;
+
+  for (Shard& shard : shards) {
+    shard.socket = -1;
+    shard.restarts = 0;
+  }
+  live_shards = &shards;
+  for (uint32_t index = 0; index < num_shards; index++) {
+    StartShard(index, num_shards, worker, &shards[index]);
+  }
+
+  uint32_t num_live = num_shards;
+  while (num_live > 0) {
+    std::vector<pollfd> fds;
+    std::vector<uint32_t> indices;
+    for (uint32_t index = 0; index < num_shards; index++) {
+      if (shards[index].socket >= 0) {
+        pollfd fd = {shards[index].socket, POLLIN, 0};
+        fds.push_back(fd);
+        indices.push_back(index);
+      }
+    }
+    if (poll(fds.data(), fds.size(), -1) < 0) {
+      assert(errno == EINTR);
+      continue;
+    }
+
+    for (uint32_t i = 0; i < fds.size(); i++) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      uint32_t index = indices[i];
+      Shard& shard = shards[index];
+      ShardMessage header;
+      bool alive = !shard.stopped &&
+          ReceiveShardMessage(shard.socket, &header, &keys);
+
+      if (alive && header.type == kShardTriples) {
+        uint32_t duplicates = 0;
+        for (uint64_t key : keys) {
+          if (claimed.insert(key).second) {
+            shard.queue.push_back(key);
+          } else {
+            duplicates++;
+          }
+        }
+        printf("[!] Shard %u: %u triples (%u already covered)\n", index,
+            header.count, duplicates);
+        alive = SendWork(&shard);
+      } else if (alive && header.type == kShardResult) {
+        totals->triples += shard.in_flight.size();
+        totals->bitflips += header.bitflips;
+        alive = SendWork(&shard);
+      } else if (alive) {
+        fprintf(stderr, "[-] Shard %u: unexpected message %u\n", index,
+            header.type);
+        alive = false;
+      }
+      if (alive) {
+        continue;
+      }
+
+      // The worker is done or gone.
+      int status = 0;
+      close(shard.socket);
+      shard.socket = -1;
+      waitpid(shard.pid, &status, 0);
+      if (shard.stopped && WIFEXITED(status) &&
+          WEXITSTATUS(status) == EXIT_SUCCESS) {
+        printf("[!] Shard %u: finished\n", index);
+        num_live--;
+        continue;
+      }
+
+      // Release what the worker did not finish; its memory is gone, so a
+      // restarted worker reports fresh triples.
+      for (uint64_t key : shard.in_flight) {
+        claimed.erase(key);
+      }
+      for (uint64_t key : shard.queue) {
+        claimed.erase(key);
+      }
+      if (WIFSIGNALED(status)) {
+        fprintf(stderr, "[-] Shard %u: worker %d killed by signal %d, "
+            "%zu triples lost\n", index, shard.pid, WTERMSIG(status),
+            shard.in_flight.size() + shard.queue.size());
+      } else {
+        fprintf(stderr, "[-] Shard %u: worker %d exited with %d, "
+            "%zu triples lost\n", index, shard.pid, WEXITSTATUS(status),
+            shard.in_flight.size() + shard.queue.size());
+      }
+      if (shard.restarts < kMaxShardRestarts) {
+        shard.restarts++;
+        totals->restarts++;
+        StartShard(index, num_shards, worker, &shard);
+      } else {
+        fprintf(stderr, "[-] Shard %u: giving up after %u restarts\n", index,
+            shard.restarts);
+        num_live--;
+      }
+    }
+    if (planned_triples != NULL) {
+      planned_triples->store(claimed.size(), std::memory_order_relaxed);
+    }
+  }
+  live_shards = NULL;
+}
+
+void StopShards() {
+  if (live_shards == NULL) {
+    return;
+  }
+  for (const Shard& shard : *live_shards) {
+    if (shard.socket >= 0) {
+      kill(shard.pid, SIGKILL);
+    }
+  }
+}
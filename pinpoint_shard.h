@@ -0,0 +1,98 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Sweeps sharded over several worker processes on one host.
+//
+// RunCoordinator() forks one worker per shard, each connected through its
+// own Unix socket pair. A worker maps its own slice of memory, reports the
+// row triples it can build (kShardTriples) and then asks for work. The
+// coordinator hands every triple to exactly one worker in batches
+// (kShardWork), merges the flip counts the workers send back
+// (kShardResult) and tells a worker to exit once nothing is left for it
+// (kShardStop). Every worker message is answered by kShardWork or
+// kShardStop.
+//
+// A worker that dies (e.g. killed by the OOM killer) only loses its own
+// shard: its unfinished triples are released and the shard is restarted,
+// up to kMaxShardRestarts times. Triples already finished are not handed
+// out again.
+
+#ifndef PINPOINT_SHARD_H_
+#define PINPOINT_SHARD_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <vector>
+
+enum ShardMessageType {
+  kShardTriples,
+  kShardResult,
+  kShardWork,
+  kShardStop,
+};
+
+// Header of every message, followed by count triple keys for kShardTriples
+// and kShardWork.
+struct ShardMessage {
+  uint32_t type;
+  uint32_t count;
+  // Flips found in the triples of a kShardResult.
+  uint64_t bitflips;
+};
+
+const uint32_t kShardBatchTriples = 16;
+const uint32_t kMaxShardRestarts = 3;
+
+// Identifies the bank part of a target row across processes.
+inline uint64_t TripleKey(uint64_t target_row, uint8_t bank) {
+  return (target_row << 8) | bank;
+}
+
+inline uint64_t TripleKeyRow(uint64_t key) {
+  return key >> 8;
+}
+
+inline uint8_t TripleKeyBank(uint64_t key) {
+  return key & 0xff;
+}
+
+// Sends header and keys. Returns false if the peer is gone.
+bool SendShardMessage(int socket, const ShardMessage& header,
+    const std::vector<uint64_t>& keys);
+
+// Receives a message into header and keys. Returns false on EOF or errors.
+bool ReceiveShardMessage(int socket, ShardMessage* header,
+    std::vector<uint64_t>* keys);
+
+// Body of a worker process. The process exits successfully when it returns.
+typedef void (ShardWorker)(uint32_t shard, uint32_t num_shards, int socket);
+
+// Merged results of all shards.
+struct ShardTotals {
+  uint64_t triples;
+  uint64_t bitflips;
+  uint32_t restarts;
+};
+
+// Forks num_shards workers running worker and coordinates them until all
+// have stopped. totals is updated as results arrive, so it can be printed
+// if the coordinator is interrupted. If planned_triples is not NULL, it
+// tracks the number of triples claimed by live or finished workers.
+void RunCoordinator(uint32_t num_shards, ShardWorker* worker,
+    std::atomic<uint64_t>* planned_triples, ShardTotals* totals);
+
+// Kills all live workers, e.g. when the time is up.
+void StopShards();
+
+#endif  // PINPOINT_SHARD_H_
@@ -0,0 +1,86 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "pinpoint_telemetry.h"
+
+#include <algorithm>
+#include <fcntl.h>
+#include <new>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+TelemetrySegment* CreateTelemetry(const char* name, uint32_t num_workers,
+    uint32_t num_banks) {
+  int fd = shm_open(name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return NULL;
+  }
+  if (ftruncate(fd, sizeof(TelemetrySegment)) != 0) {
+    close(fd);
+    shm_unlink(name);
+    return NULL;
+  }
+  void* mapping = mmap(NULL, sizeof(TelemetrySegment),
+      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    shm_unlink(name);
+    return NULL;
+  }
+
+  // The new segment is zero filled, which is what every counter starts at.
+  TelemetrySegment* segment = new (mapping) TelemetrySegment();
+  segment->num_workers = std::min(num_workers, kMaxTelemetryWorkers);
+  segment->num_banks = num_banks;
+  segment->start_ns = TelemetryNow();
+  std::atomic_thread_fence(std::memory_order_release);
+  segment->magic = kTelemetryMagic;
+  return segment;
+}
+
+const TelemetrySegment* OpenTelemetry(const char* name) {
+  int fd = shm_open(name, O_RDONLY, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat status;
+  if (fstat(fd, &status) != 0 ||
+      status.st_size < static_cast<off_t>(sizeof(TelemetrySegment))) {
+    close(fd);
+    return NULL;
+  }
+  void* mapping = mmap(NULL, sizeof(TelemetrySegment), PROT_READ, MAP_SHARED,
+      fd, 0);
+  close(fd);
+  if (mapping == MAP_FAILED) {
+    return NULL;
+  }
+  const TelemetrySegment* segment =
+      static_cast<const TelemetrySegment*>(mapping);
+  if (segment->magic != kTelemetryMagic) {
+    munmap(mapping, sizeof(TelemetrySegment));
+    return NULL;
+  }
+  return segment;
+}
+
+void UnlinkTelemetry(const char* name) {
+  shm_unlink(name);
+}
+
+WorkerTelemetry* DiscardedTelemetry() {
+  static WorkerTelemetry discarded;
+  return &discarded;
+}
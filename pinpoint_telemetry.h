@@ -0,0 +1,96 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Live progress counters in a POSIX shared memory segment.
+//
+// pinpoint_rowhammer creates /dev/shm/pinpoint_rowhammer.<pid> with one
+// WorkerTelemetry slot per process (slot 0, or one per shard in coordinator
+// mode) and pinpoint_top samples it. Every counter has a single writer, the
+// hammer or the analysis thread of its worker, so updates are a relaxed
+// load and store with no locked instruction and nothing for the reader to
+// contend on.
+
+#ifndef PINPOINT_TELEMETRY_H_
+#define PINPOINT_TELEMETRY_H_
+
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include "pinpoint_module.h"
+
+const uint32_t kTelemetryMagic = 0x31545050;  // "PPT1"
+const uint32_t kMaxTelemetryWorkers = 64;
+const uint32_t kMaxTelemetryBanks = 32;
+
+struct alignas(64) WorkerTelemetry {
+  // Process writing this slot, 0 if unused.
+  std::atomic<uint64_t> pid;
+  // Monotonic time of the last finished triple or follow-up.
+  std::atomic<uint64_t> heartbeat_ns;
+
+  // Hammer thread.
+  std::atomic<uint64_t> triples_done;
+  // Hammer kernel runs and the memory reads (activations) they issued.
+  std::atomic<uint64_t> hammer_runs;
+  std::atomic<uint64_t> hammer_reads;
+  // Mapping and indexing, hammering.
+  std::atomic<uint64_t> setup_ns;
+  std::atomic<uint64_t> hammer_ns;
+
+  // Analysis thread.
+  std::atomic<uint64_t> verify_ns;
+  std::atomic<uint64_t> flips_per_bank[kMaxTelemetryBanks];
+  // Flips of the eight pattern scan of each flipping row, not of detection.
+  std::atomic<uint64_t> flips_per_pattern[kNumDataPatterns];
+};
+
+struct TelemetrySegment {
+  uint32_t magic;
+  uint32_t num_workers;
+  uint32_t num_banks;
+  uint64_t start_ns;
+  // Triples the run is going to hammer, for the ETA. Written by the process
+  // that plans the work (the coordinator in coordinator mode).
+  std::atomic<uint64_t> planned_triples;
+  WorkerTelemetry workers[kMaxTelemetryWorkers];
+};
+
+inline uint64_t TelemetryNow() {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+// Adds value to a counter owned by the calling thread.
+inline void TelemetryAdd(std::atomic<uint64_t>* counter, uint64_t value) {
+  counter->store(counter->load(std::memory_order_relaxed) + value,
+      std::memory_order_relaxed);
+}
+
+// Creates and maps the segment called name (e.g. "/pinpoint_rowhammer.42").
+// Returns NULL if shared memory is not available. num_workers is clamped to
+// kMaxTelemetryWorkers.
+TelemetrySegment* CreateTelemetry(const char* name, uint32_t num_workers,
+    uint32_t num_banks);
+
+// Maps an existing segment read-only. Returns NULL if there is none.
+const TelemetrySegment* OpenTelemetry(const char* name);
+
+// Removes the name; mappings stay valid.
+void UnlinkTelemetry(const char* name);
+
+// A slot for runs without a segment, so writers never check for NULL.
+WorkerTelemetry* DiscardedTelemetry();
+
+#endif  // PINPOINT_TELEMETRY_H_
@@ -0,0 +1,244 @@
+// Copyright 2019, Sangwoo Ji
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Shows the progress counters of a running pinpoint_rowhammer (see
+// pinpoint_telemetry.h). The segment is mapped read-only, so sampling does
+// not slow the hammering down.
+//
+// Compilation instructions:
+//   ./make.sh pinpoint_top
+//
+// ./pinpoint_top [-i seconds] [-n samples] [pid]
+//
+// Samples every interval seconds (default 5), n times or until interrupted.
+// Without a pid, the only pinpoint_rowhammer segment in /dev/shm is used.
+
+#include <algorithm>
+#include <dirent.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <unistd.h>
+#include <vector>
+#include "pinpoint_telemetry.h"
+
+namespace {
+
+const char kSegmentPrefix[] = "pinpoint_rowhammer.";
+
+// Workers without a finished triple for this long are reported as stalled.
+const double kStallSeconds = 60;
+
+double sample_interval = 5;
+uint32_t number_of_samples = 0;
+
+// A copy of the counters of one worker.
+struct WorkerSample {
+  uint64_t pid;
+  uint64_t heartbeat_ns;
+  uint64_t triples_done;
+  uint64_t hammer_reads;
+  uint64_t setup_ns;
+  uint64_t hammer_ns;
+  uint64_t verify_ns;
+};
+
+struct Sample {
+  uint64_t time_ns;
+  uint64_t planned_triples;
+  std::vector<WorkerSample> workers;
+  std::vector<uint64_t> flips_per_bank;
+  std::vector<uint64_t> flips_per_pattern;
+};
+
+uint64_t Load(const std::atomic<uint64_t>& counter) {
+  return counter.load(std::memory_order_relaxed);
+}
+
+void TakeSample(const TelemetrySegment& segment, Sample* sample) {
+  uint32_t num_workers = std::min(segment.num_workers, kMaxTelemetryWorkers);
+  uint32_t num_banks = std::min(segment.num_banks, kMaxTelemetryBanks);
+  sample->time_ns = TelemetryNow();
+  sample->planned_triples = Load(segment.planned_triples);
+  sample->workers.assign(num_workers, WorkerSample());
+  sample->flips_per_bank.assign(num_banks, 0);
+  sample->flips_per_pattern.assign(kNumDataPatterns, 0);
+  for (uint32_t i = 0; i < num_workers; i++) {
+    const WorkerTelemetry& worker = segment.workers[i];
+    WorkerSample& copy = sample->workers[i];
+    copy.pid = Load(worker.pid);
+    copy.heartbeat_ns = Load(worker.heartbeat_ns);
+    copy.triples_done = Load(worker.triples_done);
+    copy.hammer_reads = Load(worker.hammer_reads);
+    copy.setup_ns = Load(worker.setup_ns);
+    copy.hammer_ns = Load(worker.hammer_ns);
+    copy.verify_ns = Load(worker.verify_ns);
+    for (uint32_t bank = 0; bank < num_banks; bank++) {
+      sample->flips_per_bank[bank] += Load(worker.flips_per_bank[bank]);
+    }
+    for (uint32_t pattern = 0; pattern < kNumDataPatterns; pattern++) {
+      sample->flips_per_pattern[pattern] +=
+          Load(worker.flips_per_pattern[pattern]);
+    }
+  }
+}
+
+void PrintDuration(const char* label, double seconds) {
+  if (seconds < 120) {
+    printf("%s %.0f s", label, seconds);
+  } else if (seconds < 7200) {
+    printf("%s %.1f min", label, seconds / 60);
+  } else {
+    printf("%s %.1f h", label, seconds / 3600);
+  }
+}
+
+void PrintSample(const TelemetrySegment& segment, const Sample& previous,
+    const Sample& current) {
+  double elapsed = (current.time_ns - segment.start_ns) * 1e-9;
+  double interval = (current.time_ns - previous.time_ns) * 1e-9;
+  uint64_t done = 0;
+  uint64_t previous_done = 0;
+  for (uint32_t i = 0; i < current.workers.size(); i++) {
+    done += current.workers[i].triples_done;
+    previous_done += previous.workers[i].triples_done;
+  }
+  double rate = (done - previous_done) / interval;
+
+  PrintDuration("[!]", elapsed);
+  printf(" elapsed, %lu", done);
+  if (current.planned_triples > 0) {
+    printf("/%lu triples (%.1f%%)", current.planned_triples,
+        100.0 * done / current.planned_triples);
+  } else {
+    printf(" triples");
+  }
+  printf(", %.2f triples/s", rate);
+  if (rate > 0 && current.planned_triples > done) {
+    PrintDuration(", ETA", (current.planned_triples - done) / rate);
+  }
+  printf("\n");
+
+  printf("    worker      pid   triples triples/s  reads/s  setup hammer "
+      "verify  heartbeat\n");
+  for (uint32_t i = 0; i < current.workers.size(); i++) {
+    const WorkerSample& worker = current.workers[i];
+    const WorkerSample& before = previous.workers[i];
+    if (worker.pid == 0) {
+      printf("    %6u  (not started)\n", i);
+      continue;
+    }
+    double wall_ns = elapsed * 1e9;
+    double age = worker.heartbeat_ns > 0 ?
+        (current.time_ns - worker.heartbeat_ns) * 1e-9 : elapsed;
+    printf("    %6u %8lu %9lu %9.2f %7.1fM %5.1f%% %5.1f%% %5.1f%% "
+        "%8.1f s%s\n", i, worker.pid, worker.triples_done,
+        (worker.triples_done - before.triples_done) / interval,
+        (worker.hammer_reads - before.hammer_reads) / interval * 1e-6,
+        100 * worker.setup_ns / wall_ns, 100 * worker.hammer_ns / wall_ns,
+        100 * worker.verify_ns / wall_ns, age,
+        age > kStallSeconds ? "  STALLED" : "");
+  }
+
+  printf("    flips per bank:   ");
+  for (uint64_t flips : current.flips_per_bank) {
+    printf(" %lu", flips);
+  }
+  printf("\n    flips per pattern:");
+  for (uint64_t flips : current.flips_per_pattern) {
+    printf(" %lu", flips);
+  }
+  printf("\n\n");
+}
+
+// Returns the shared memory name of the only pinpoint_rowhammer segment, or
+// an empty string if there are none or several.
+std::string FindSegment() {
+  std::vector<std::string> names;
+  DIR* directory = opendir("/dev/shm");
+  if (directory != NULL) {
+    struct dirent* entry;
+    while ((entry = readdir(directory)) != NULL) {
+      if (strncmp(entry->d_name, kSegmentPrefix,
+            sizeof(kSegmentPrefix) - 1) == 0) {
+        names.push_back(std::string("/") + entry->d_name);
+      }
+    }
+    closedir(directory);
+  }
+  if (names.size() == 1) {
+    return names[0];
+  }
+  fprintf(stderr, "[-] Found %zu running pinpoint_rowhammer processes, "
+      "pass a pid\n", names.size());
+  for (const std::string& name : names) {
+    fprintf(stderr, "    %s\n", name.c_str() + sizeof(kSegmentPrefix));
+  }
+  return std::string();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  // Turn off stdout buffering when it is a pipe.
+  setvbuf(stdout, NULL, _IONBF, 0);
+
+  int opt;
+  while ((opt = getopt(argc, argv, "i:n:")) != -1) {
+    switch (opt) {
+      case 'i':
+        sample_interval = atof(optarg);
+        break;
+      case 'n':
+        number_of_samples = atoi(optarg);
+        break;
+      default:
+        fprintf(stderr, "Usage: %s [-i seconds] [-n samples] [pid]\n",
+            argv[0]);
+        exit(EXIT_FAILURE);
+    }
+  }
+  if (sample_interval <= 0) {
+    fprintf(stderr, "[-] The interval must be positive\n");
+    exit(EXIT_FAILURE);
+  }
+
+  std::string name;
+  if (optind < argc) {
+    name = std::string("/") + kSegmentPrefix + argv[optind];
+  } else {
+    name = FindSegment();
+    if (name.empty()) {
+      exit(EXIT_FAILURE);
+    }
+  }
+  const TelemetrySegment* segment = OpenTelemetry(name.c_str());
+  if (segment == NULL) {
+    fprintf(stderr, "[-] Can't open /dev/shm%s\n", name.c_str());
+    exit(EXIT_FAILURE);
+  }
+
+  Sample previous;
+  Sample current;
+  TakeSample(*segment, &previous);
+  for (uint32_t n = 0; number_of_samples == 0 || n < number_of_samples;
+      n++) {
+    usleep(sample_interval * 1e6);
+    TakeSample(*segment, &current);
+    PrintSample(*segment, previous, current);
+    previous = current;
+  }
+}